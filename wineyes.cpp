@@ -11,22 +11,26 @@
 #include <windows.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "wineyes.h"
 
-#define LEYE 0
-#define REYE 1
-#define NUM_EYES 2
-
 static HINSTANCE hInst;
-static int    reset_clipping_region = 1;
-static POINT  eyecenter[NUM_EYES];
-static POINT  eyesize;
-static POINT  eyeballsize;
-static RECT   prevloc[NUM_EYES] = {{0,0,0,0},{0,0,0,0}};
 //
-// Displaying menu bar by default.
+// The face of a huge window is rendered by the tile renderer into
+// this surface, and then blitted. The thread pool is shared by the
+// windows.
+//
+struct FaceSurface {
+	HDC     hDc;
+	HBITMAP hBitmap;
+	HBITMAP hOld;
+	struct EyesFrame frame;
+};
+static struct EyesTilePool *g_tilePool;
 //
-static int show_menu = 1;
+// Timer of the held back update of the remote mode.
+//
+#define ID_REMOTE_TIMER 1
 //
 // Deprecated: 
 // Original version was not clipping the client area 
@@ -38,11 +42,6 @@ static bool g_legacyShowMenu = false;
 // Low level handler for mouse motion.
 // 
 static HHOOK g_hMouseHook;
-static HWND g_hWnd;
-//
-// Setup the window to be topmost by default. 
-// 
-static bool g_showTopMost = true;
 
 //
 // Command line option.
@@ -53,64 +52,154 @@ static bool g_showTopMost = true;
 //   xeyes.exe -geometry +XOFF+YOFF
 //   xeyes.exe -monitor screen_no   
 //     screen_no: 1, 2, ...
+//   xeyes.exe -export TRACE [-fps N] [-output FILE] [-format y4m|bgra]
+//             [-threads N] [-benchmark] [-geometry WIDTHxHEIGHT+XOFF+YOFF]
+//   xeyes.exe -remote [-remote-fps N] [-remote-kbps N] [-remote-grid N]
+//   xeyes.exe -noremote
+//   xeyes.exe -newinstance
 // 
-static int g_geometryXoff;
-static int g_geometryYoff;
-static int g_geometryWidth;
-static int g_geometryHeight;
-static int g_monitorNumber;
-
-enum commandOption {
-	OPT_NONE,       // No argument.
-	OPT_GEOMETRY,   // -geometry
-	OPT_MONITOR,    // -monitor
-};
-
+static struct EyesOptions g_options;
 //
-// Default value for command line option
+// The command line encoded to be forwarded to the running instance.
 //
-#define DEFAULT_X 0
-#define DEFAULT_Y 0
-#define DEFAULT_W 150
-#define DEFAULT_H 100
-#define DEFAULT_SCREEN_NO 1
+#define LAUNCH_TIMEOUT_MS 2000
+static uint8_t g_launchMessage[LAUNCH_MAX_BYTES];
+static size_t g_launchBytes;
 
 //
-// Maximum number of monitors to be retrieved.
-// Change this value if you want to increase the maximum value.
-// 
-#define MAX_SCREEN_NO 32
+// Window of a pair of eyes. The running instance opens one more window
+// for each launch forwarded to it, and the windows share the hook, the
+// monitor information and the tile pool.
+//
+// The state includes whether the menu bar is displayed, the window is
+// topmost and the window is being dragged.
+//
+#define MAX_EYES_WINDOWS 64
+struct EyesWindow {
+	HWND   hWnd;
+	struct EyesOptions options;
+	struct EyesState state;
+	struct EyesLayout layout;
+	RECT   prevloc[NUM_EYES];
+	POINT  mouseloc;
+	struct PupilAtlas pupilAtlas;
+	//
+	// Clip of the pupils to the whites of the eyes, for the layout size.
+	//
+	HRGN   scleraRgn;
+	struct EyesPoint scleraSize;
+	struct FaceSurface faceSurface;
+	//
+	// Render cache of the face at the size the window is opened with.
+	//
+	struct FaceCache faceCache;
+	//
+	// Bandwidth budget of the remote mode, and the pupils last sent.
+	//
+	struct EyesBudget budget;
+	struct EyesPoint remotePupil[NUM_EYES];
+};
+static struct EyesWindow *g_windows[MAX_EYES_WINDOWS];
+static int g_windowCount;
 
 //
 // Multi monitor information
 //
+// It is enumerated once, and again after the display is changed.
+//
 struct MonitorInfoData
 {
 	MONITORINFOEX entry;
 };
 static struct MonitorInfoData g_monitorInfo[MAX_SCREEN_NO];
 static int g_monitorInfoCount;
+static bool g_monitorInfoValid;
+
 
+//
+// Create a region from the spans of the eyes.
+//
+static HRGN CreateSpanRgn(const struct EyesSpan *spans, int nspans, int loff, int toff)
+{
+	RGNDATA *data;
+	RECT *rects;
+	HRGN hRgn;
+	DWORD size;
+
+	if (nspans < 0 || (size_t)nspans > (MAXDWORD - sizeof(RGNDATAHEADER)) / sizeof(RECT))
+		return NULL;
+	size = (DWORD)(sizeof(RGNDATAHEADER) + (size_t)nspans * sizeof(RECT));
+
+	data = (RGNDATA *)malloc(size);
+	if (data == NULL)
+		return NULL;
+
+	data->rdh.dwSize = sizeof(RGNDATAHEADER);
+	data->rdh.iType = RDH_RECTANGLES;
+	data->rdh.nCount = (DWORD)nspans;
+	data->rdh.nRgnSize = (DWORD)((size_t)nspans * sizeof(RECT));
+	SetRect(&data->rdh.rcBound, 0, 0, 0, 0);
+	rects = (RECT *)data->Buffer;
+	for (int i = 0; i < nspans; i++) {
+		rects[i].left = spans[i].x0 + loff;
+		rects[i].top = spans[i].y + toff;
+		rects[i].right = spans[i].x1 + loff;
+		rects[i].bottom = spans[i].y + 1 + toff;
+	}
+
+	hRgn = ExtCreateRegion(NULL, size, data);
+	free(data);
+	return hRgn;
+}
 
-enum WinEyesMouseState { WEMS_NONE, WEMS_IN_MOVE };
-static WinEyesMouseState mouse_state = WEMS_NONE;
+HRGN WinEyesScleraRgn(const struct EyesLayout *layout)
+{
+	struct EyesSpan *spans;
+	HRGN hRgn;
+	int nspans;
+
+	if (layout->size.y <= 0)
+		return NULL;
+	spans = (struct EyesSpan *)malloc((size_t)layout->size.y * NUM_EYES * sizeof(*spans));
+	if (spans == NULL)
+		return NULL;
+	nspans = EyesScleraSpans(layout, layout->size.y, spans);
+	hRgn = CreateSpanRgn(spans, nspans, 0, 0);
+	free(spans);
+	return hRgn;
+}
+
+//
+// The render cache, if it is valid for the client size.
+//
+static struct EyesCache *FaceCacheFor(struct EyesWindow *w, int width, int height)
+{
+	struct EyesCache *cache = &w->faceCache.cache;
 
+	if (!w->faceCache.valid || cache->key.width != width || cache->key.height != height)
+		return NULL;
+	return cache;
+}
 
 //
 // Setup the clipping region which includes left eye, 
 // right eye and window caption.
 //
-void setClippingRegion(HWND hWnd)
+void setClippingRegion(struct EyesWindow *w)
 {
-	if (g_legacyShowMenu && show_menu) {
+	HWND hWnd = w->hWnd;
+
+	if (g_legacyShowMenu && w->state.showMenu) {
 		SetWindowRgn(hWnd, NULL, 1);
 	}
 	else {
-		POINT size;
-		RECT forEllipse1, forEllipse2, winrect, rect;
-		HRGN leye, reye;
+		RECT winrect, rect;
+		HRGN leye;
 		int loff, toff;
 		POINT client_origin;
+		const struct EyesCache *cache;
+		struct EyesSpan *spans;
+		int nspans;
 
 		// Get window rectangle in screen coordinates.
 		GetWindowRect(hWnd, &winrect);
@@ -125,28 +214,32 @@ void setClippingRegion(HWND hWnd)
 		client_origin.x -= winrect.left;
 		client_origin.y -= winrect.top;
 
-		size.x = rect.right - rect.left;
-		size.y = rect.bottom - rect.top;
-		forEllipse1.left = rect.left + 1;
-		forEllipse1.right = (long)(size.x / 2 - size.x * 0.025 + 1);
-		forEllipse1.top = rect.top + 1;
-		forEllipse1.bottom = size.y;
-		forEllipse2.right = rect.right - 1;
-		forEllipse2.left = (long)(forEllipse1.right + size.x * 0.05) - 1;
-		forEllipse2.top = rect.top + 1;
-		forEllipse2.bottom = size.y;
 		loff = client_origin.x;
 		toff = client_origin.y;
-		leye = CreateEllipticRgn(forEllipse1.left + loff, forEllipse1.top + toff,
-			forEllipse1.right + loff, forEllipse1.bottom + toff);
-		reye = CreateEllipticRgn(forEllipse2.left + loff, forEllipse2.top + toff,
-			forEllipse2.right + loff, forEllipse2.bottom + toff);
-		CombineRgn(leye, leye, reye, RGN_OR);
+
+		//
+		// The region is made of the same ellipses as the paint.
+		//
+		EyesUpdateLayout(rect.right - rect.left, rect.bottom - rect.top, &w->layout);
+		cache = FaceCacheFor(w, rect.right - rect.left, rect.bottom - rect.top);
+		if (cache) {
+			leye = CreateSpanRgn(cache->spans, cache->nspans, loff, toff);
+		}
+		else {
+			spans = (struct EyesSpan *)malloc((rect.bottom - rect.top) * NUM_EYES * sizeof(*spans));
+			if (spans == NULL)
+				return;
+			nspans = EyesRegionSpans(&w->layout, rect.bottom - rect.top, spans);
+			leye = CreateSpanRgn(spans, nspans, loff, toff);
+			free(spans);
+		}
+		if (leye == NULL)
+			return;
 
 		//
 		// Adding the window title bar to the region.
 		// 
-		if (show_menu) {
+		if (w->state.showMenu) {
 			int width = winrect.right - winrect.left;
 			int height = toff;
 			HRGN topbar = CreateRectRgn(0, 0, width, height);
@@ -157,151 +250,288 @@ void setClippingRegion(HWND hWnd)
 	}
 }
 
+//
+// Pass the update of the pupils to the budget of the remote mode.
+// Returns false if it is not to be drawn now. A held back update is
+// retried by the timer with the latest cursor position.
+//
+static bool RemoteAdmit(struct EyesWindow *w, struct EyesPoint pupil[NUM_EYES], bool force)
+{
+	const RECT *prevloc = w->prevloc;
+	bool drawn = prevloc[LEYE].left < prevloc[LEYE].right;
+	long long now = (long long)GetTickCount64();
+	long long cost;
+	int wait;
+
+	EyesBudgetQuantize(&w->budget, &w->layout, pupil);
+	cost = EyesPupilChange(drawn ? w->remotePupil : NULL, pupil, w->layout.eyeballsize);
+
+	if (force) {
+		EyesBudgetCharge(&w->budget, now, cost);
+	}
+	else {
+		//
+		// The pupils snapped back to where they are drawn.
+		//
+		if (drawn && memcmp(pupil, w->remotePupil, sizeof(w->remotePupil)) == 0) {
+			w->budget.pending = false;
+			KillTimer(w->hWnd, ID_REMOTE_TIMER);
+			return false;
+		}
+
+		wait = EyesBudgetRequest(&w->budget, now, cost);
+		if (wait > 0) {
+			SetTimer(w->hWnd, ID_REMOTE_TIMER, wait, NULL);
+			return false;
+		}
+	}
+
+	KillTimer(w->hWnd, ID_REMOTE_TIMER);
+	memcpy(w->remotePupil, pupil, sizeof(w->remotePupil));
+	return true;
+}
+
 //
 // Change the line of sight of left and right eyes 
 // to the mouse cursor position.
+//
+// ForceRedrawEyes is TRUE after the face is painted, or UPDATE_RETRY
+// when the held back update of the remote mode is retried.
 // 
-void WinEyesUpdate(HWND hWnd, int ForceRedrawEyes)
+#define UPDATE_RETRY 2
+
+void WinEyesUpdate(struct EyesWindow *w, int ForceRedrawEyes)
 {
-	RECT  forEllipse1, forEllipse2;
-	POINT newmouseloc, current1, current2, relmouse[2];
+	RECT  ball[NUM_EYES];
+	POINT newmouseloc;
+	struct EyesPoint relmouse, pupil[NUM_EYES];
 	POINT win_origin;
 	HDC   hDc;
-	double len;
-	double eyecos[2], eyesin[2];
-	static POINT mouseloc;
+	HWND  hWnd = w->hWnd;
+	RECT  *prevloc = w->prevloc;
 
 	GetCursorPos((LPPOINT)&newmouseloc);
-	if ((mouseloc.x == newmouseloc.x) && (mouseloc.y == newmouseloc.y) && (!ForceRedrawEyes))
+	if ((w->mouseloc.x == newmouseloc.x) && (w->mouseloc.y == newmouseloc.y) && (!ForceRedrawEyes)) {
+		FlightRecord(FR_UPDATE_SKIP, newmouseloc.x, newmouseloc.y, 0);
 		return;
+	}
+	FlightRecord(FR_UPDATE, newmouseloc.x, newmouseloc.y, 0);
 
-	mouseloc.x = newmouseloc.x, mouseloc.y = newmouseloc.y;
+	w->mouseloc.x = newmouseloc.x, w->mouseloc.y = newmouseloc.y;
 
 	hDc = GetDC(hWnd);
 
 	GetDCOrgEx(hDc, &win_origin);
 
-	relmouse[LEYE].x = mouseloc.x - win_origin.x - eyecenter[LEYE].x;
-	relmouse[LEYE].y = mouseloc.y - win_origin.y - eyecenter[LEYE].y;
-	relmouse[REYE].x = mouseloc.x - win_origin.x - eyecenter[REYE].x;
-	relmouse[REYE].y = mouseloc.y - win_origin.y - eyecenter[REYE].y;
-
-	if ((relmouse[LEYE].x != 0) || (relmouse[LEYE].y != 0)) {
-		len = sqrt((double)(relmouse[LEYE].x * relmouse[LEYE].x + relmouse[LEYE].y * relmouse[LEYE].y));
-		eyecos[LEYE] = relmouse[LEYE].x / len;
-		eyesin[LEYE] = relmouse[LEYE].y / len;
-	}
-	else {
-		eyecos[LEYE] = 0; eyesin[LEYE] = 0;
-	}
-	if ((relmouse[REYE].x != 0) || (relmouse[REYE].y != 0)) {
-		len = sqrt((double)(relmouse[REYE].x * relmouse[REYE].x + relmouse[REYE].y * relmouse[REYE].y));
-		eyecos[REYE] = relmouse[REYE].x / len;
-		eyesin[REYE] = relmouse[REYE].y / len;
-	}
-	else {
-		eyecos[REYE] = 0; eyesin[REYE] = 0;
-	}
+	relmouse.x = w->mouseloc.x - win_origin.x;
+	relmouse.y = w->mouseloc.y - win_origin.y;
+	EyesLookAt(relmouse, &w->layout, pupil);
 
-	current1.x = (int)(eyecos[LEYE] * eyesize.x); current1.y = (int)(eyesin[LEYE] * eyesize.y);
-	current2.x = (int)(eyecos[REYE] * eyesize.x); current2.y = (int)(eyesin[REYE] * eyesize.y);
-	if (current1.x * current1.x + current1.y * current1.y >
-		relmouse[LEYE].x * relmouse[LEYE].x + relmouse[LEYE].y * relmouse[LEYE].y) {
-		current1.x = relmouse[LEYE].x;
-		current1.y = relmouse[LEYE].y;
-	}
-	if (current2.x * current2.x + current2.y * current2.y >
-		relmouse[REYE].x * relmouse[REYE].x + relmouse[REYE].y * relmouse[REYE].y) {
-		current2.x = relmouse[REYE].x;
-		current2.y = relmouse[REYE].y;
+	if (w->options.remote && !RemoteAdmit(w, pupil, ForceRedrawEyes == TRUE)) {
+		ReleaseDC(hWnd, hDc);
+		return;
 	}
-	current1.x += eyecenter[LEYE].x;
-	current1.y += eyecenter[LEYE].y;
-	current2.x += eyecenter[REYE].x;
-	current2.y += eyecenter[REYE].y;
 
-	forEllipse1.left = current1.x - eyeballsize.x, forEllipse1.top = current1.y - eyeballsize.y;
-	forEllipse1.right = current1.x + eyeballsize.x, forEllipse1.bottom = current1.y + eyeballsize.y;
+	//
+	// The atlas is rebuilt lazily after the eyeball size is changed.
+	//
+	PupilAtlasPrepare(&w->pupilAtlas, hDc, w->layout.eyeballsize);
 
-	forEllipse2.left = current2.x - eyeballsize.x, forEllipse2.top = current2.y - eyeballsize.y;
-	forEllipse2.right = current2.x + eyeballsize.x, forEllipse2.bottom = current2.y + eyeballsize.y;
+	//
+	// The cells of the pupils are rectangles, whose corners may be
+	// outside of the whites of the eyes. The old pupils are erased and
+	// the new ones drawn only inside of the whites.
+	//
+	if (w->scleraRgn == NULL ||
+		w->scleraSize.x != w->layout.size.x || w->scleraSize.y != w->layout.size.y) {
+		if (w->scleraRgn)
+			DeleteObject(w->scleraRgn);
+		w->scleraRgn = WinEyesScleraRgn(&w->layout);
+		w->scleraSize = w->layout.size;
+	}
+	SelectClipRgn(hDc, w->scleraRgn);
 
 	if (prevloc[LEYE].left < prevloc[LEYE].right)
 	{
-		SelectObject(hDc, GetStockObject(WHITE_PEN));
-		SelectObject(hDc, GetStockObject(WHITE_BRUSH));
-		Ellipse(hDc, prevloc[LEYE].left, prevloc[LEYE].top, prevloc[LEYE].right, prevloc[LEYE].bottom);
-		Ellipse(hDc, prevloc[REYE].left, prevloc[REYE].top, prevloc[REYE].right, prevloc[REYE].bottom);
+		PatBlt(hDc, prevloc[LEYE].left, prevloc[LEYE].top,
+			prevloc[LEYE].right - prevloc[LEYE].left, prevloc[LEYE].bottom - prevloc[LEYE].top, WHITENESS);
+		PatBlt(hDc, prevloc[REYE].left, prevloc[REYE].top,
+			prevloc[REYE].right - prevloc[REYE].left, prevloc[REYE].bottom - prevloc[REYE].top, WHITENESS);
 	}
 
-	SelectObject(hDc, GetStockObject(BLACK_BRUSH));
-	SelectObject(hDc, GetStockObject(BLACK_PEN));
-	Ellipse(hDc, forEllipse1.left, forEllipse1.top, forEllipse1.right, forEllipse1.bottom);
-	Ellipse(hDc, forEllipse2.left, forEllipse2.top, forEllipse2.right, forEllipse2.bottom);
+	PupilAtlasDraw(&w->pupilAtlas, hDc, pupil[LEYE], &ball[LEYE]);
+	PupilAtlasDraw(&w->pupilAtlas, hDc, pupil[REYE], &ball[REYE]);
 
-	prevloc[LEYE].left = forEllipse1.left, prevloc[LEYE].top = forEllipse1.top;
-	prevloc[LEYE].right = forEllipse1.right, prevloc[LEYE].bottom = forEllipse1.bottom;
-	prevloc[REYE].left = forEllipse2.left, prevloc[REYE].top = forEllipse2.top;
-	prevloc[REYE].right = forEllipse2.right, prevloc[REYE].bottom = forEllipse2.bottom;
+	prevloc[LEYE] = ball[LEYE];
+	prevloc[REYE] = ball[REYE];
 
+	SelectClipRgn(hDc, NULL);
 	ReleaseDC(hWnd, hDc);
 }
 
-void WinEyesPaint(HWND hWnd)
+//
+// Draw the outline and the white of both eyes.
+//
+void WinEyesDrawFace(HDC hDc, const struct EyesLayout *layout)
 {
-	PAINTSTRUCT ps;
-	POINT size;
-	RECT  forEllipse1, forEllipse2, rect;
+	const struct EyesRect *o = layout->outline;
+	const struct EyesRect *s = layout->sclera;
+	HRGN sclera;
+
+	SelectObject(hDc, GetStockObject(BLACK_BRUSH) );
+	SelectObject(hDc, GetStockObject(BLACK_PEN) );
+	Ellipse(hDc, o[LEYE].left, o[LEYE].top, o[LEYE].right, o[LEYE].bottom);
+	Ellipse(hDc, o[REYE].left, o[REYE].top, o[REYE].right, o[REYE].bottom);
 
-	if (reset_clipping_region){
-		setClippingRegion(hWnd);
-		reset_clipping_region = 0;
+	//
+	// The whites are the clip of the pupils, so that a pupil never
+	// touches the outline.
+	//
+	sclera = WinEyesScleraRgn(layout);
+	if (sclera) {
+		FillRgn(hDc, sclera, (HBRUSH)GetStockObject(WHITE_BRUSH));
+		DeleteObject(sclera);
+		return;
+	}
+	SelectObject(hDc, GetStockObject(WHITE_BRUSH) );
+	SelectObject(hDc, GetStockObject(WHITE_PEN) );
+	Ellipse(hDc, s[LEYE].left, s[LEYE].top, s[LEYE].right, s[LEYE].bottom);
+	Ellipse(hDc, s[REYE].left, s[REYE].top, s[REYE].right, s[REYE].bottom);
+}
+
+static void FaceSurfaceFree(struct FaceSurface *fs)
+{
+	if (fs->hDc) {
+		SelectObject(fs->hDc, fs->hOld);
+		DeleteObject(fs->hBitmap);
+		DeleteDC(fs->hDc);
+	}
+	ZeroMemory(fs, sizeof(*fs));
+}
+
+//
+// The surface is reallocated after the window is resized.
+//
+static bool FaceSurfacePrepare(struct FaceSurface *fs, int width, int height)
+{
+	BITMAPINFO bmi;
+	uint32_t *bits = NULL;
+
+	if (fs->hDc && fs->frame.width == width && fs->frame.height == height)
+		return true;
+
+	if (fs->hDc) {
+		SelectObject(fs->hDc, fs->hOld);
+		DeleteObject(fs->hBitmap);
+		DeleteDC(fs->hDc);
+	}
+	ZeroMemory(fs, sizeof(*fs));
+	if (g_tilePool == NULL)
+		g_tilePool = EyesTilePoolCreate(0);
+
+	ZeroMemory(&bmi, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = width;
+	bmi.bmiHeader.biHeight = -height;  // top-down
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	fs->hDc = CreateCompatibleDC(NULL);
+	if (fs->hDc == NULL)
+		return false;
+	fs->hBitmap = CreateDIBSection(fs->hDc, &bmi, DIB_RGB_COLORS, (void **)&bits, NULL, 0);
+	if (fs->hBitmap == NULL) {
+		DeleteDC(fs->hDc);
+		fs->hDc = NULL;
+		return false;
 	}
+	fs->hOld = (HBITMAP)SelectObject(fs->hDc, fs->hBitmap);
+	fs->frame.bits = bits;
+	fs->frame.stride = width;
+	fs->frame.width = width;
+	fs->frame.height = height;
+	return true;
+}
+
+void WinEyesPaint(struct EyesWindow *w)
+{
+	HWND  hWnd = w->hWnd;
+	PAINTSTRUCT ps;
+	RECT  rect;
+	int   width, height;
+	struct EyesCache *cache;
+
+	FlightRecord(FR_PAINT, 0, 0, 0);
+
 	GetClientRect( hWnd, &rect );
-	size.x = rect.right-rect.left;
-	size.y = rect.bottom-rect.top;
-	forEllipse1.left   = rect.left + 1;
-	forEllipse1.right  = (long)(size.x/2 - size.x*0.025);
-	forEllipse1.top    = rect.top + 1;
-	forEllipse1.bottom = size.y;
-	forEllipse2.right  = rect.right - 1;
-	forEllipse2.left   = (long)(forEllipse1.right + size.x*0.05);
-	forEllipse2.top    = rect.top + 1;
-	forEllipse2.bottom = size.y;
+	width = rect.right - rect.left;
+	height = rect.bottom - rect.top;
+	EyesUpdateLayout(width, height, &w->layout);
 
 	BeginPaint(hWnd, (LPPAINTSTRUCT)&ps);
 
-	if (g_legacyShowMenu && show_menu){
-		FillRect(ps.hdc, & rect, (HBRUSH) GetStockObject(WHITE_BRUSH));
-	}
-
-
-	SelectObject(ps.hdc, GetStockObject(BLACK_BRUSH) );
-	SelectObject(ps.hdc, GetStockObject(BLACK_PEN) );
-	Ellipse(ps.hdc, forEllipse1.left, forEllipse1.top, forEllipse1.right, forEllipse1.bottom);
-	Ellipse(ps.hdc, forEllipse2.left, forEllipse2.top, forEllipse2.right, forEllipse2.bottom);
-
-	forEllipse1.left +=size.x/2/10; 	forEllipse1.right -=size.x/2/10;
-	forEllipse1.top +=size.y/10;    forEllipse1.bottom -= size.y/10;
-	forEllipse2.left +=size.x/2/10; 	forEllipse2.right -=size.x/2/10;
-	forEllipse2.top +=size.y/10;    forEllipse2.bottom -= size.y/10;
-
-	SelectObject(ps.hdc, GetStockObject(WHITE_BRUSH) );
-	SelectObject(ps.hdc, GetStockObject(WHITE_PEN) );
-	Ellipse(ps.hdc, forEllipse1.left, forEllipse1.top, forEllipse1.right, forEllipse1.bottom);
-	Ellipse(ps.hdc, forEllipse2.left, forEllipse2.top, forEllipse2.right, forEllipse2.bottom);
-	
-	eyecenter[LEYE].x=(forEllipse1.right+forEllipse1.left)/2+1;
-	eyecenter[LEYE].y=(forEllipse1.top+forEllipse1.bottom)/2+1;
-	
-	eyecenter[REYE].x=(forEllipse2.right+forEllipse2.left)/2+1;
-	eyecenter[REYE].y=eyecenter[LEYE].y;
-
-	eyesize.x = (long)((forEllipse1.right - forEllipse1.left)/2/1.7);
-	eyesize.y = (long)((forEllipse1.bottom - forEllipse1.top)/2/1.7);
-	eyeballsize.x = (long)(eyesize.x/2.5);
-	eyeballsize.y = (long)(eyesize.y/2.5);
-	WinEyesUpdate(hWnd, TRUE);
+	//
+	// A broken band of the cached face is painted without the cache,
+	// and the cache is rebuilt.
+	//
+	cache = FaceCacheFor(w, width, height);
+	if (cache && !EyesCacheCheckRows(cache, ps.rcPaint.top, ps.rcPaint.bottom)) {
+		FaceCacheReject(&w->faceCache);
+		cache = NULL;
+	}
+	if (cache) {
+		//
+		// The damaged rows of the cached face are blitted from the
+		// mapped file as they are.
+		//
+		BITMAPINFO bmi;
+		const RECT *d = &ps.rcPaint;
+		int top = d->top < 0 ? 0 : d->top;
+		int bottom = d->bottom > height ? height : d->bottom;
+
+		if (top < bottom) {
+			ZeroMemory(&bmi, sizeof(bmi));
+			bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+			bmi.bmiHeader.biWidth = width;
+			bmi.bmiHeader.biHeight = -(bottom - top);  // top-down
+			bmi.bmiHeader.biPlanes = 1;
+			bmi.bmiHeader.biBitCount = 32;
+			bmi.bmiHeader.biCompression = BI_RGB;
+			SetDIBitsToDevice(ps.hdc, d->left, top, d->right - d->left, bottom - top,
+				d->left, 0, 0, bottom - top, cache->bits + (size_t)top * width, &bmi, DIB_RGB_COLORS);
+		}
+	}
+	else if ((long long)width * height >= TILE_PAINT_MIN_PIXELS &&
+		FaceSurfacePrepare(&w->faceSurface, width, height)) {
+		//
+		// Only the tiles of the damaged area are rendered in parallel.
+		// The background is also filled with white.
+		//
+		struct EyesRect damage;
+		const RECT *d = &ps.rcPaint;
+
+		damage.left = d->left;
+		damage.top = d->top;
+		damage.right = d->right;
+		damage.bottom = d->bottom;
+		EyesPaintFace(g_tilePool, &w->faceSurface.frame, &w->layout, &damage);
+		BitBlt(ps.hdc, d->left, d->top, d->right - d->left, d->bottom - d->top,
+			w->faceSurface.hDc, d->left, d->top, SRCCOPY);
+	}
+	else {
+		if (g_legacyShowMenu && w->state.showMenu){
+			FillRect(ps.hdc, & rect, (HBRUSH) GetStockObject(WHITE_BRUSH));
+		}
+
+		WinEyesDrawFace(ps.hdc, &w->layout);
+	}
+
+	//
+	// The eyeballs have been painted over by the face.
+	//
+	ZeroMemory(w->prevloc, sizeof(w->prevloc));
+	WinEyesUpdate(w, TRUE);
 	EndPaint(hWnd, (LPPAINTSTRUCT)&ps);
 }
 
@@ -322,14 +552,14 @@ BOOL CALLBACK About(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 	return(FALSE);
 }
 
-void ShowTopMost(void)
+void ShowTopMost(struct EyesWindow *w)
 {
 	HMENU hMenu;
-	HWND hWnd = g_hWnd;
+	HWND hWnd = w->hWnd;
 
 	hMenu = GetSystemMenu(hWnd, FALSE);
 
-	if (g_showTopMost) {
+	if (w->state.showTopMost) {
 		CheckMenuItem(hMenu, ID_ALWAYS_ON_TOP, MF_BYCOMMAND | MF_CHECKED);
 		SetWindowPos(hWnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE);
 	}
@@ -366,122 +596,186 @@ void TerminateAllApplications(void)
 	}
 }
 
+//
+// Carry out the effects returned by the state machine.
+//
+static LRESULT WinEyesApplyEffects(struct EyesWindow *w, UINT message, WPARAM wParam, LPARAM lParam,
+	const struct EyesEffect *effects, int n)
+{
+	HWND hWnd = w->hWnd;
+	LRESULT ret = FALSE;
+
+	for (int i = 0; i < n; i++) {
+		const struct EyesEffect *ef = &effects[i];
+
+		switch (ef->type)
+		{
+		case EF_SET_REGION:
+			setClippingRegion(w);
+			break;
+
+		case EF_PAINT:
+			WinEyesPaint(w);
+			break;
+
+		case EF_REDRAW:
+			RedrawWindow(hWnd, NULL, NULL, RDW_ERASE | RDW_FRAME | RDW_INVALIDATE);
+			break;
+
+		case EF_CAPTURE:
+			SetCapture(hWnd);
+			break;
+
+		case EF_RELEASE_CAPTURE:
+			ReleaseCapture();
+			break;
+
+		case EF_SET_CURSOR:
+			SetCursor(LoadCursor(NULL, IDC_HAND));
+			break;
+
+		case EF_MOVE_WINDOW:
+			MoveWindow(hWnd, ef->rect.left, ef->rect.top,
+				ef->rect.right - ef->rect.left, ef->rect.bottom - ef->rect.top, 1);
+			break;
+
+		case EF_RESIZE_CLIENT:
+		{
+			RECT r;
+			r.left = ef->rect.left;
+			r.top = ef->rect.top;
+			r.right = ef->rect.right;
+			r.bottom = ef->rect.bottom;
+			AdjustWindowRectEx(&r, WS_OVERLAPPEDWINDOW, 0, WS_EX_TOOLWINDOW);
+			SetWindowPos(hWnd, HWND_TOP, 0, 0, r.right - r.left, r.bottom - r.top, SWP_NOMOVE);
+			break;
+		}
+
+		case EF_SET_TOPMOST:
+			ShowTopMost(w);
+			break;
+
+		case EF_DEFAULT:
+			ret = DefWindowProc(hWnd, message, wParam, lParam);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return ret;
+}
+
+static struct EyesWindow *WinEyesOpen(const struct EyesOptions *opt);
+
+//
+// Release the window which is being destroyed.
+//
+static void WinEyesClose(struct EyesWindow *w)
+{
+	for (int i = 0; i < g_windowCount; i++) {
+		if (g_windows[i] == w) {
+			g_windows[i] = g_windows[--g_windowCount];
+			break;
+		}
+	}
+
+	KillTimer(w->hWnd, ID_REMOTE_TIMER);
+	SetWindowLongPtr(w->hWnd, GWLP_USERDATA, 0);
+	PupilAtlasFree(&w->pupilAtlas);
+	if (w->scleraRgn)
+		DeleteObject(w->scleraRgn);
+	FaceSurfaceFree(&w->faceSurface);
+	FaceCacheClose(&w->faceCache);
+	free(w);
+}
+
 LRESULT CALLBACK PASCAL WinEyesWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
 	FARPROC lpProcAbout;
 	HMENU hMenu;
-	static int dragx = 0, dragy = 0;
+	struct EyesEvent ev;
+	struct EyesEffect effects[EYES_MAX_EFFECTS];
+	struct EyesWindow *w;
+	int n;
+
+	//
+	// The window is given by WinEyesOpen() to CreateWindowEx().
+	//
+	if (message == WM_CREATE) {
+		w = (struct EyesWindow *)((LPCREATESTRUCT)lParam)->lpCreateParams;
+		w->hWnd = hWnd;
+		SetWindowLongPtr(hWnd, GWLP_USERDATA, (LONG_PTR)w);
+	}
+	w = (struct EyesWindow *)GetWindowLongPtr(hWnd, GWLP_USERDATA);
+	if (w == NULL)
+		return (DefWindowProc(hWnd, message, wParam, lParam));
+
+	ZeroMemory(&ev, sizeof(ev));
 
 	switch (message)
 	{
 	case WM_PAINT:
-		WinEyesPaint(hWnd);
+		ev.type = EV_PAINT;
 		break;
 
 	case WM_MOVE:
-		WinEyesPaint(hWnd);
+		ev.type = EV_MOVE;
 		break;
 
 	case WM_SIZE:
-		reset_clipping_region = 1;
-		RedrawWindow(hWnd, NULL, NULL, RDW_ERASE | RDW_FRAME | RDW_INVALIDATE);
+		ev.type = EV_SIZE;
 		break;
 
 	case WM_LBUTTONDOWN:
-		mouse_state = WEMS_IN_MOVE;
-		SetCapture(hWnd);
-		dragx = (short)LOWORD(lParam);
-		dragy = (short)HIWORD(lParam);
+		ev.type = EV_LBUTTONDOWN;
+		ev.pos.x = (short)LOWORD(lParam);
+		ev.pos.y = (short)HIWORD(lParam);
 		break;
 
 	case WM_LBUTTONUP:
-		if (mouse_state == WEMS_IN_MOVE) {
-			mouse_state = WEMS_NONE;
-			ReleaseCapture();
-		}
+		ev.type = EV_LBUTTONUP;
 		break;
 
 	case WM_LBUTTONDBLCLK:
 	case WM_RBUTTONUP:
-	{
-		show_menu = show_menu ^ 1;
-		reset_clipping_region = 1;
-		RedrawWindow(hWnd, NULL, NULL, RDW_ERASE | RDW_FRAME | RDW_INVALIDATE);
+		ev.type = EV_TOGGLE_MENU;
 		break;
-	}
 
 	case WM_MOUSEMOVE:
 	{
-		//
-		// Changes the mouse cursor type while the cursor is 
-		// moving over my application.
-		//
-		HCURSOR cursor = LoadCursor(NULL, IDC_HAND);
-		SetCursor(cursor);
-
-		//
-		// The entire application window is moved not just the frame
-		// while you are dragging.
-		//
-		if (mouse_state == WEMS_IN_MOVE) {
-			static POINT mouseloc;
-			POINT newmouseloc;
-			RECT r;
-			GetWindowRect(hWnd, &r);
-			newmouseloc.x = r.left + (short)LOWORD(lParam);
-			newmouseloc.y = r.top + (short)HIWORD(lParam);
-			if ((newmouseloc.x != mouseloc.x) || (newmouseloc.y != mouseloc.y)) {
-				mouseloc.x = newmouseloc.x;
-				mouseloc.y = newmouseloc.y;
-				MoveWindow(hWnd, r.left + (short)LOWORD(lParam) - dragx,
-					r.top + (short)HIWORD(lParam) - dragy, r.right - r.left, r.bottom - r.top, 1);
-			}
-		}
-		else {
-			return (DefWindowProc(hWnd, message, wParam, lParam));
-		}
+		RECT r;
+		GetWindowRect(hWnd, &r);
+		ev.type = EV_MOUSEMOVE;
+		ev.pos.x = (short)LOWORD(lParam);
+		ev.pos.y = (short)HIWORD(lParam);
+		ev.window.left = r.left;
+		ev.window.top = r.top;
+		ev.window.right = r.right;
+		ev.window.bottom = r.bottom;
+		break;
 	}
-	break;
 
 	case WM_SYSCOMMAND:
 		if (wParam == ID_ABOUT) {
 			DialogBox(hInst, "AboutBox", hWnd, About);
 			FreeProcInstance(lpProcAbout);
-			break;
+			return (FALSE);
 		}
 		else if (wParam == ID_DEFAULT_SIZE) {
 			RECT r;
-			r.left = DEFAULT_X;
-			r.top = DEFAULT_Y;
-			r.right = DEFAULT_W;
-			r.bottom = DEFAULT_H;
-			AdjustWindowRectEx(&r, WS_OVERLAPPEDWINDOW, 0, WS_EX_TOOLWINDOW);
-			SetWindowPos(hWnd, HWND_TOP, 0, 0, r.right - r.left, r.bottom - r.top, SWP_NOMOVE);
-
-			//
-			// Bug fix in original version:
-			// The eyeball is incorrectly rendered after resizing.
-			// So, the clipping area is to be reset and redrawn.
-			//
-			WinEyesPaint(hWnd);
-			reset_clipping_region = 1;
-			RedrawWindow(hWnd, NULL, NULL, RDW_ERASE | RDW_FRAME | RDW_INVALIDATE);
-			break;
+			GetClientRect(hWnd, &r);
+			ev.type = EV_DEFAULT_SIZE;
+			ev.pos.x = r.right - r.left;
+			ev.pos.y = r.bottom - r.top;
 		}
 		else if (wParam == ID_ALWAYS_ON_TOP) {
-			hMenu = GetSystemMenu(hWnd, FALSE);
-			if (GetMenuState(hMenu, ID_ALWAYS_ON_TOP, MF_BYCOMMAND) & MF_CHECKED) {
-				g_showTopMost = false;
-				ShowTopMost();
-			}
-			else {
-				g_showTopMost = true;
-				ShowTopMost();
-			}
+			ev.type = EV_TOGGLE_TOPMOST;
 		}
 		else if (wParam == ID_TERMINATE_ALL) {
 			TerminateAllApplications();
-
+			return (FALSE);
 		}
 		else {
 			return(DefWindowProc(hWnd, message, wParam, lParam));
@@ -498,17 +792,51 @@ LRESULT CALLBACK PASCAL WinEyesWndProc(HWND hWnd, UINT message, WPARAM wParam, L
 		InsertMenu(hMenu, 4, MF_STRING | MF_BYPOSITION, ID_TERMINATE_ALL, "&Terminate all xeyes");
 		AppendMenu(hMenu, MF_SEPARATOR, NULL, NULL);
 		AppendMenu(hMenu, MF_STRING, ID_ABOUT, "A&bout Xeyes for Windows...");
-		break;
+		return (FALSE);
+
+	case WM_TIMER:
+		if (wParam == ID_REMOTE_TIMER) {
+			KillTimer(hWnd, ID_REMOTE_TIMER);
+			WinEyesUpdate(w, UPDATE_RETRY);
+		}
+		return (FALSE);
+
+	case WM_COPYDATA:
+	{
+		//
+		// A launch forwarded by another xeyes.exe opens one more window.
+		// The export and the recording are not run by this process,
+		// whoever sends them.
+		//
+		const COPYDATASTRUCT *cds = (const COPYDATASTRUCT *)lParam;
+		struct EyesOptions opt;
+
+		if (cds == NULL || cds->dwData != LAUNCH_MAGIC ||
+			!EyesLaunchDecode((const uint8_t *)cds->lpData, cds->cbData, &opt) ||
+			!EyesLaunchForwardable(&opt))
+			return (FALSE);
+		return (WinEyesOpen(&opt) != NULL);
+	}
+
+	case WM_DISPLAYCHANGE:
+		g_monitorInfoValid = false;
+		return (DefWindowProc(hWnd, message, wParam, lParam));
 
 	case WM_DESTROY:
-		PostQuitMessage(0);
-		break;
+		//
+		// The process exits with the last window.
+		//
+		WinEyesClose(w);
+		if (g_windowCount == 0)
+			PostQuitMessage(0);
+		return (FALSE);
 
 	default:
 		return (DefWindowProc(hWnd, message, wParam, lParam));
 	}
 
-	return (FALSE);
+	n = EyesStateHandle(&w->state, &ev, effects);
+	return WinEyesApplyEffects(w, message, wParam, lParam, effects, n);
 }
 
 
@@ -548,7 +876,15 @@ LRESULT CALLBACK GlobalMouseHandler(int nCode, WPARAM wParam, LPARAM lParam)
 
 	if (pMouseStruct != NULL) {
 		if (wParam == WM_MOUSEMOVE) {
-			WinEyesUpdate(g_hWnd, FALSE);
+			//
+			// The low level hook passes MSLLHOOKSTRUCT, which also
+			// begins with the cursor position.
+			//
+			const MSLLHOOKSTRUCT* pLLStruct = (const MSLLHOOKSTRUCT*)lParam;
+
+			FlightRecord(FR_CURSOR, pLLStruct->pt.x, pLLStruct->pt.y, pLLStruct->time);
+			for (int i = 0; i < g_windowCount; i++)
+				WinEyesUpdate(g_windows[i], FALSE);
 
 			//DEBUG_PRINT("wParam %x Mouse position X = %d  Mouse Position Y = %d\n", wParam, pMouseStruct->pt.x, pMouseStruct->pt.y);
 		}
@@ -587,22 +923,26 @@ BOOL CALLBACK AllMonitorInfoEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT l
 	return true;
 }
 
-void MoveApplWindow(void)
+void MoveApplWindow(const struct EyesWindow *win)
 {
+	const struct EyesOptions *opt = &win->options;
 	bool outside = false;
 	int x, y, w, h;
 	int nx, ny, nw, nh;
 
-	nx = g_geometryXoff;
-	ny = g_geometryYoff;
-	nw = g_geometryWidth;
-	nh = g_geometryHeight;
+	nx = opt->geometryXoff;
+	ny = opt->geometryYoff;
+	nw = opt->geometryWidth;
+	nh = opt->geometryHeight;
 
-	g_monitorInfoCount = 0;
-	EnumDisplayMonitors(NULL, NULL, AllMonitorInfoEnumProc, NULL);
-	if (g_monitorNumber <= g_monitorInfoCount) {
+	if (!g_monitorInfoValid) {
+		g_monitorInfoCount = 0;
+		EnumDisplayMonitors(NULL, NULL, AllMonitorInfoEnumProc, NULL);
+		g_monitorInfoValid = true;
+	}
+	if (opt->monitorNumber <= g_monitorInfoCount) {
 		int mx, my, mw, mh;
-		int index = g_monitorNumber - 1;
+		int index = opt->monitorNumber - 1;
 
 		if (index >= 0) {
 			MONITORINFOEX ent = g_monitorInfo[index].entry;
@@ -657,109 +997,157 @@ void MoveApplWindow(void)
 	r.bottom = nh;
 	AdjustWindowRectEx(&r, WS_OVERLAPPEDWINDOW, 0, WS_EX_TOOLWINDOW);
 
-	MoveWindow(g_hWnd, nx, ny, r.right - r.left, r.bottom - r.top, TRUE);
+	MoveWindow(win->hWnd, nx, ny, r.right - r.left, r.bottom - r.top, TRUE);
+}
+
+//
+// Open a window of a pair of eyes.
+//
+static struct EyesWindow *WinEyesOpen(const struct EyesOptions *opt)
+{
+	struct EyesWindow *w;
+	struct EyesCacheKey key;
+	HWND hWnd;
+	RECT r;
+
+	if (g_windowCount >= MAX_EYES_WINDOWS)
+		return NULL;
+	w = (struct EyesWindow *)calloc(1, sizeof(*w));
+	if (w == NULL)
+		return NULL;
+	w->options = *opt;
+	EyesStateInit(&w->state);
+
+	//
+	// The updates are bandwidth budgeted on a remote desktop session.
+	//
+	if (GetSystemMetrics(SM_REMOTESESSION) && !w->options.noRemote)
+		w->options.remote = true;
+	if (w->options.remote)
+		EyesBudgetInit(&w->budget, w->options.remoteFps, w->options.remoteKbps * 1024,
+			w->options.remoteGrid, (long long)GetTickCount64());
+
+	r.left = DEFAULT_X;
+	r.top = DEFAULT_Y;
+	r.right = DEFAULT_W;
+	r.bottom = DEFAULT_H;
+	AdjustWindowRectEx(&r, WS_OVERLAPPEDWINDOW, 0, WS_EX_TOOLWINDOW);
+
+	hWnd = CreateWindowEx(
+		WS_EX_TOOLWINDOW, // Make a tool window so that it doesn't appear in the taskbar
+		WINEYES_APPNAME,
+		WINEYES_TITLE,
+		WS_OVERLAPPEDWINDOW,
+		CW_USEDEFAULT,
+		CW_USEDEFAULT,
+		r.right - r.left,
+		r.bottom - r.top,
+		NULL,
+		NULL,
+		hInst,
+		w
+	);
+
+	if (!hWnd)
+	{
+		free(w);
+		return NULL;
+	}
+	g_windows[g_windowCount++] = w;
+
+	MoveApplWindow(w);
+
+	//
+	// The first frame is a blit of the cached face if there is one.
+	//
+	GetClientRect(hWnd, &r);
+	key.width = r.right - r.left;
+	key.height = r.bottom - r.top;
+	FaceCacheOpen(&w->faceCache, &key);
+
+	setClippingRegion(w);
+	w->state.resetClippingRegion = 0;
+	ShowWindow(hWnd, SW_RESTORE);
+	UpdateWindow(hWnd);
+
+	ShowTopMost(w);
+	return w;
+}
+
+//
+// Pass the launch to the running instance.
+// Returns false if there is none, or it does not respond.
+//
+static bool ForwardLaunch(void)
+{
+	COPYDATASTRUCT cds;
+	DWORD_PTR result = FALSE;
+	HWND hWnd;
+
+	if (g_launchBytes == 0)
+		return false;
+	hWnd = FindWindow(WINEYES_APPNAME, NULL);
+	if (hWnd == NULL)
+		return false;
+
+	cds.dwData = LAUNCH_MAGIC;
+	cds.cbData = (DWORD)g_launchBytes;
+	cds.lpData = g_launchMessage;
+	if (!SendMessageTimeout(hWnd, WM_COPYDATA, 0, (LPARAM)&cds,
+		SMTO_ABORTIFHUNG, LAUNCH_TIMEOUT_MS, &result))
+		return false;
+	return result == TRUE;
 }
 
 void AnalyzeCommandOption(void)
 {
 	WCHAR *cmdLine;
-	WCHAR** argv, ** argv_org;
+	WCHAR** argv;
 	int argc;
-	enum commandOption optType;
-	bool nextSecondParam = false;
 
 	cmdLine = GetCommandLineW();
 	argv = CommandLineToArgvW(cmdLine, &argc);
-	argv_org = argv;
-
-	argc--;
-	argv++;
-
-	g_geometryXoff = DEFAULT_X;
-	g_geometryYoff = DEFAULT_Y;
-	g_geometryWidth = DEFAULT_W;
-	g_geometryHeight = DEFAULT_H;
-	g_monitorNumber = DEFAULT_SCREEN_NO;
-
-	for (int i = 0; i < argc; i++) {
-		if (nextSecondParam) {
-			nextSecondParam = false;
-
-			switch (optType) {
-			case OPT_GEOMETRY: 
-			{
-				int w, h, x, y;
-				int n = swscanf_s(argv[i], L"%dx%d+%d+%d", &w, &h, &x, &y);
-				DEBUG_PRINT("%d %ws %d\n", i, argv[i], n);
-				if (n == 4) {
-					g_geometryXoff = x;
-					g_geometryYoff = y;
-					g_geometryWidth = w;
-					g_geometryHeight = h;
-					break;
-				}
-
-				n = swscanf_s(argv[i], L"%dx%d", &w, &h);
-				DEBUG_PRINT("%d %ws %d\n", i, argv[i], n);
-				if (n == 2) {
-					g_geometryWidth = w;
-					g_geometryHeight = h;
-					break;
-				}
-
-				n = swscanf_s(argv[i], L"+%d+%d", &x, &y);
-				DEBUG_PRINT("%d %ws %d\n", i, argv[i], n);
-				if (n == 2) {
-					g_geometryXoff = x;
-					g_geometryYoff = y;
-					break;
-				}
-				break;
-			}
-
-			case OPT_MONITOR:
-			{
-				int val;
-				int n = swscanf_s(argv[i], L"%d", &val);
-				DEBUG_PRINT("%d %ws %d\n", i, argv[i], n);
-				if (n == 1) {
-					if (!(val >= DEFAULT_SCREEN_NO && val <= MAX_SCREEN_NO))
-						val = 1;
-					g_monitorNumber = val;
-				}
-				break;
-			}
-
-			default:
-				break;
-			}
-
-		}
-		else {
-			if (lstrcmpW(argv[i], L"-geometry") == 0) {
-				optType = OPT_GEOMETRY;
-				nextSecondParam = true;
-			} else if (lstrcmpW(argv[i], L"-monitor") == 0) {
-				optType = OPT_MONITOR;
-				nextSecondParam = true;
-			}
-		}
+	if (argv == NULL) {
+		EyesParseOptions(0, NULL, &g_options);
+		g_launchBytes = EyesLaunchEncode(0, NULL, g_launchMessage, sizeof(g_launchMessage));
+		return;
 	}
 
-	LocalFree(argv_org);
+	EyesParseOptions(argc - 1, argv + 1, &g_options);
+	g_launchBytes = EyesLaunchEncode(argc - 1, argv + 1, g_launchMessage, sizeof(g_launchMessage));
+	for (int i = 1; i < argc; i++)
+		DEBUG_PRINT("%d %ws\n", i, argv[i]);
+
+	LocalFree(argv);
 }
 
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nCmdShow)
 {
-	HWND hWnd;
 	MSG msg;
-	RECT r;
 
 	//
 	// Paser command line options.
 	//
 	AnalyzeCommandOption();
 
+	//
+	// Render the cursor trace into a video stream without 
+	// creating any window.
+	//
+	if (g_options.exportMode) {
+		g_options.exportOption.width = g_options.geometryWidth;
+		g_options.exportOption.height = g_options.geometryHeight;
+		g_options.exportOption.xoff = g_options.geometryXoff;
+		g_options.exportOption.yoff = g_options.geometryYoff;
+		return WinEyesExport(&g_options.exportOption);
+	}
+
+	//
+	// The running instance opens the window with its hook and caches
+	// which are already warm.
+	//
+	if (EyesLaunchForwardable(&g_options) && ForwardLaunch())
+		return 0;
 
 	if (!WinEyesInit(hInstance))
 	{
@@ -769,51 +1157,26 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 
 	hInst = hInstance;
 
-	r.left = DEFAULT_X;
-	r.top = DEFAULT_Y;
-	r.right = DEFAULT_W;
-	r.bottom = DEFAULT_H;
-	AdjustWindowRectEx(&r, WS_OVERLAPPEDWINDOW, 0, WS_EX_TOOLWINDOW);
-
-	hWnd = CreateWindowEx(
-		WS_EX_TOOLWINDOW, // Make a tool window so that it doesn't appear in the taskbar
-		WINEYES_APPNAME,
-		WINEYES_TITLE,
-		WS_OVERLAPPEDWINDOW,
-		CW_USEDEFAULT,
-		CW_USEDEFAULT,
-		r.right - r.left,
-		r.bottom - r.top,
-		NULL,
-		NULL,
-		hInstance,
-		NULL
-	);
-
-	if (!hWnd)
+	if (WinEyesOpen(&g_options) == NULL)
 	{
 		char buf[80];
 		snprintf(buf, sizeof(buf), "Could not create window %d", GetLastError());
 		MessageBox(NULL, buf, "Error", MB_OK);
 		return(0);
 	}
-	//
-	// Save the window handle.
-	// 
-	g_hWnd = hWnd;
 
 	//
 	// Add low level handler of mouse motion.
 	//
 	g_hMouseHook = SetWindowsHookEx(WH_MOUSE_LL, GlobalMouseHandler, hInstance, NULL);
 
-	MoveApplWindow();
-
-	setClippingRegion(hWnd);
-	ShowWindow(hWnd, SW_RESTORE);
-	UpdateWindow(hWnd);
-
-	ShowTopMost();
+	//
+	// Record the cursor samples into the flight recording.
+	//
+	if (g_options.recordPath[0] != L'\0') {
+		if (!FlightRecorderStart(g_options.recordPath, (size_t)g_options.recordSize * 1024 * 1024))
+			MessageBox(NULL, "Could not start the flight recorder", "Error", MB_OK);
+	}
 
 	while (GetMessage(&msg, NULL, (int)NULL, (int)NULL))
 	{
@@ -825,6 +1188,10 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 	// Remove low level handler of mouse motion.
 	//
 	UnhookWindowsHookEx(g_hMouseHook);
+	FlightRecorderStop();
+	FaceCacheWait();
+
+	EyesTilePoolFree(g_tilePool);
 
 	return(msg.wParam);
 }
@@ -24,6 +24,102 @@
 #define WINEYES_APPNAME  "XeyesForWindows"
 #define WINEYES_TITLE	"Xeyes for Windows"
 
+#ifndef RC_INVOKED
+
+#include "wineyes_core.h"
+#include "wineyes_state.h"
+#include "wineyes_flight.h"
+#include "wineyes_tile.h"
+#include "wineyes_remote.h"
+#include "wineyes_launch.h"
+#include "wineyes_cache.h"
+
+//
+// Sub-pixel pupil sprite atlas (wineyes_atlas.cpp)
+//
+// ATLAS_PHASES x ATLAS_PHASES sprites are built per eyeball size.
+// The phases are halved while the atlas exceeds ATLAS_MAX_BYTES.
+//
+#define ATLAS_PHASES    4
+#define ATLAS_MAX_BYTES (4 * 1024 * 1024)
+
+struct PupilAtlas {
+	bool    valid;      // Built for ebsize
+	struct EyesPoint ebsize;  // Eyeball size
+	int     phases;     // Phases per axis, or 0 to draw by Ellipse()
+	struct EyesPoint cell;    // Sprite size
+	HDC     hDc;
+	HBITMAP hBitmap;
+	HBITMAP hOld;
+};
+
+void PupilAtlasPrepare(struct PupilAtlas *atlas, HDC hDc, struct EyesPoint ebsize);
+void PupilAtlasDraw(const struct PupilAtlas *atlas, HDC hDc, struct EyesPoint pupil, RECT *drawn);
+void PupilAtlasFree(struct PupilAtlas *atlas);
+
+//
+// Headless frame export (wineyes_export.cpp)
+//
+int WinEyesExport(const struct ExportOption *opt);
+
+void WinEyesDrawFace(HDC hDc, const struct EyesLayout *layout);
+
+//
+// Region of the whites of the eyes, or NULL.
+//
+HRGN WinEyesScleraRgn(const struct EyesLayout *layout);
+
+//
+// Cursor flight recorder (wineyes_record.cpp)
+//
+// g_flightRing is NULL while the recorder is stopped.
+//
+extern struct FlightRing *g_flightRing;
+
+bool FlightRecorderStart(const WCHAR *path, size_t bytes);
+void FlightRecorderStop(void);
+
+//
+// Persistent render cache of the face (wineyes_facecache.cpp)
+//
+// FaceCacheOpen() maps the cache of the key. If it is missing or stale
+// it returns false, and the cache is rebuilt in the background for the
+// next start. FaceCacheReject() closes a cache whose bitmap is found
+// broken, and rebuilds it.
+//
+struct FaceCache {
+	bool    valid;
+	HANDLE  hFile;
+	HANDLE  hMapping;
+	const uint8_t *view;
+	struct EyesCache cache;
+};
+
+bool FaceCacheOpen(struct FaceCache *fc, const struct EyesCacheKey *key);
+void FaceCacheClose(struct FaceCache *fc);
+void FaceCacheReject(struct FaceCache *fc);
+void FaceCacheWait(void);
+
+static inline void FlightRecord(uint32_t type, int x, int y, uint32_t hookTime)
+{
+	struct FlightRing *ring = g_flightRing;
+	struct FlightEvent ev;
+	LARGE_INTEGER now;
+
+	if (ring == NULL)
+		return;
+
+	QueryPerformanceCounter(&now);
+	ev.time = (uint64_t)now.QuadPart;
+	ev.x = x;
+	ev.y = y;
+	ev.hookTime = hookTime;
+	ev.type = type;
+	FlightRingPush(ring, &ev);
+}
+
+#endif   /* RC_INVOKED */
+
 //
 // For printf debugging
 // 
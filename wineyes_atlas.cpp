@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Sub-pixel pupil sprite atlas.
+ *
+ * The anti-aliased pupil is rasterized once per eyeball size at a grid of
+ * ATLAS_PHASES x ATLAS_PHASES sub-pixel offsets. Moving the pupil is then
+ * a single BitBlt of the sprite for the nearest phase.
+ */
+
+#include <windows.h>
+#include "wineyes.h"
+
+void PupilAtlasFree(struct PupilAtlas *atlas)
+{
+	if (atlas->hDc) {
+		SelectObject(atlas->hDc, atlas->hOld);
+		DeleteObject(atlas->hBitmap);
+		DeleteDC(atlas->hDc);
+	}
+	ZeroMemory(atlas, sizeof(*atlas));
+}
+
+//
+// Build the atlas for the eyeball size unless it is already built.
+// When the atlas for the size does not fit in ATLAS_MAX_BYTES even with
+// fewer phases, the pupil is drawn by Ellipse() instead.
+//
+void PupilAtlasPrepare(struct PupilAtlas *atlas, HDC hDc, struct EyesPoint ebsize)
+{
+	BITMAPINFO bmi;
+	uint32_t *bits = NULL;
+	int phases, w, h;
+
+	if (atlas->valid && atlas->ebsize.x == ebsize.x && atlas->ebsize.y == ebsize.y)
+		return;
+
+	PupilAtlasFree(atlas);
+	atlas->ebsize = ebsize;
+	atlas->valid = true;
+
+	if (ebsize.x < 1 || ebsize.y < 1)
+		return;
+
+	w = ebsize.x * 2 + 2;
+	h = ebsize.y * 2 + 2;
+	phases = ATLAS_PHASES;
+	while (phases > 1 && (size_t)w * h * 4 * phases * phases > ATLAS_MAX_BYTES)
+		phases /= 2;
+	if (phases == 1)
+		return;
+
+	ZeroMemory(&bmi, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = w * phases;
+	bmi.bmiHeader.biHeight = -h * phases;  // top-down
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	atlas->hDc = CreateCompatibleDC(hDc);
+	if (atlas->hDc == NULL)
+		return;
+	atlas->hBitmap = CreateDIBSection(atlas->hDc, &bmi, DIB_RGB_COLORS, (void **)&bits, NULL, 0);
+	if (atlas->hBitmap == NULL) {
+		DeleteDC(atlas->hDc);
+		atlas->hDc = NULL;
+		return;
+	}
+	atlas->hOld = (HBITMAP)SelectObject(atlas->hDc, atlas->hBitmap);
+
+	//
+	// Sprite (px, py) is the pupil whose center is px/phases and
+	// py/phases pixel right and below of the integer position.
+	//
+	for (int py = 0; py < phases; py++) {
+		for (int px = 0; px < phases; px++) {
+			EyesRasterizePupil(bits + (size_t)py * h * w * phases + px * w, w * phases, w, h,
+				ebsize.x + 1 + (double)px / phases, ebsize.y + 1 + (double)py / phases,
+				ebsize.x, ebsize.y);
+		}
+	}
+	GdiFlush();
+
+	atlas->phases = phases;
+	atlas->cell.x = w;
+	atlas->cell.y = h;
+}
+
+//
+// Draw the pupil centered at the sub-pixel position, and return the
+// bounding rectangle of the pixels which are drawn.
+//
+void PupilAtlasDraw(const struct PupilAtlas *atlas, HDC hDc, struct EyesPoint pupil, RECT *drawn)
+{
+	if (atlas->phases == 0) {
+		int x = pupil.x / SUBPIXEL_ONE;
+		int y = pupil.y / SUBPIXEL_ONE;
+
+		drawn->left = x - atlas->ebsize.x, drawn->top = y - atlas->ebsize.y;
+		drawn->right = x + atlas->ebsize.x, drawn->bottom = y + atlas->ebsize.y;
+		SelectObject(hDc, GetStockObject(BLACK_BRUSH));
+		SelectObject(hDc, GetStockObject(BLACK_PEN));
+		Ellipse(hDc, drawn->left, drawn->top, drawn->right, drawn->bottom);
+		return;
+	}
+
+	int x, y;
+	int px, py;
+
+	EyesQuantizePhase(pupil.x, atlas->phases, &x, &px);
+	EyesQuantizePhase(pupil.y, atlas->phases, &y, &py);
+
+	drawn->left = x - atlas->ebsize.x - 1;
+	drawn->top = y - atlas->ebsize.y - 1;
+	drawn->right = drawn->left + atlas->cell.x;
+	drawn->bottom = drawn->top + atlas->cell.y;
+	BitBlt(hDc, drawn->left, drawn->top, atlas->cell.x, atlas->cell.y,
+		atlas->hDc, px * atlas->cell.x, py * atlas->cell.y, SRCCOPY);
+}
@@ -0,0 +1,1738 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Microbenchmark of the core kernels.
+ *
+ * Usage:
+ *   wineyes_bench [FILTER [TRACE]]
+ *     FILTER: run only the kernels whose name contains FILTER.
+ *     TRACE: cursor trace of "TIME_MS X Y" lines replayed by
+ *            remote_damage instead of the synthetic one.
+ *
+ * Each result is printed as one JSON object per line:
+ *   {"kernel":"layout","param":"150x100","iterations":N,"ns_per_op":X}
+ * The effects of the replayed window message streams are printed as:
+ *   {"kernel":"state_effects","param":"drag","events":N,...,"redundant":R}
+ * The paint of the tile renderer is reported per thread count as:
+ *   {"kernel":"paint_tiles","param":"3840x2160/t4",...}
+ * The damage of the cursor trace with and without the remote budget:
+ *   {"kernel":"remote_damage","param":"synthetic/150x100/remote",...}
+ * The compression of the flight recorder is printed as:
+ *   {"kernel":"flight_ratio","param":"hook_1000hz","events":N,"raw_bytes":R,...}
+ * The frames/second of the export per thread count:
+ *   {"kernel":"export_frames","param":"1920x1080/t4","frames":N,"seconds":S,"fps":F,...}
+ * Startup to the first frame without and with the render cache:
+ *   {"kernel":"cache_warm","param":"1920x1080/t4",...}
+ * The cold and forwarded launches of a whole process are printed as:
+ *   {"kernel":"launch_process","param":"forward","launches":N,"ms_mean":X,...}
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "wineyes_core.h"
+#include "wineyes_state.h"
+#include "wineyes_flight.h"
+#include "wineyes_tile.h"
+#include "wineyes_remote.h"
+#include "wineyes_launch.h"
+#include "wineyes_cache.h"
+
+//
+// Minimum measuring time of each kernel.
+//
+#define BENCH_MIN_NS 200000000LL
+
+typedef void (*BenchFunc)(void *ctx, long long iters);
+
+static const char *g_filter;
+static volatile long long g_sink;
+
+static long long NowNs(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Run the kernel with doubling iterations until it takes BENCH_MIN_NS.
+//
+static void RunBench(const char *kernel, const char *param, BenchFunc fn, void *ctx)
+{
+	long long iters = 1, elapsed;
+
+	if (g_filter && strstr(kernel, g_filter) == NULL)
+		return;
+
+	for (;;) {
+		long long start = NowNs();
+		fn(ctx, iters);
+		elapsed = NowNs() - start;
+		if (elapsed >= BENCH_MIN_NS || iters >= (1LL << 40))
+			break;
+		iters *= 2;
+	}
+
+	printf("{\"kernel\":\"%s\",\"param\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.3f}\n",
+		kernel, param, iters, (double)elapsed / iters);
+	fflush(stdout);
+}
+
+struct SizeParam {
+	int width;
+	int height;
+	const char *name;
+};
+
+static const struct SizeParam g_sizes[] = {
+	{ 150, 100, "150x100" },
+	{ 1920, 1080, "1920x1080" },
+	{ 7680, 2160, "7680x2160" },
+};
+
+static void BenchLayout(void *ctx, long long iters)
+{
+	const struct SizeParam *sp = (const struct SizeParam *)ctx;
+	struct EyesLayout layout;
+
+	for (long long i = 0; i < iters; i++) {
+		EyesComputeLayout(sp->width + (int)(i & 1), sp->height, &layout);
+		g_sink += layout.eyeballsize.x;
+	}
+}
+
+struct LookAtCtx {
+	struct EyesLayout layout;
+	std::vector<struct EyesPoint> path;
+};
+
+static void BenchLookAt(void *ctx, long long iters)
+{
+	struct LookAtCtx *c = (struct LookAtCtx *)ctx;
+	struct EyesPoint pupil[NUM_EYES];
+	size_t n = c->path.size();
+
+	for (long long i = 0; i < iters; i++) {
+		EyesLookAt(c->path[i % n], &c->layout, pupil);
+		g_sink += pupil[LEYE].x + pupil[REYE].y;
+	}
+}
+
+struct SpansCtx {
+	struct EyesLayout layout;
+	int height;
+	std::vector<struct EyesSpan> spans;
+};
+
+static void BenchRegionSpans(void *ctx, long long iters)
+{
+	struct SpansCtx *c = (struct SpansCtx *)ctx;
+
+	for (long long i = 0; i < iters; i++)
+		g_sink += EyesRegionSpans(&c->layout, c->height, c->spans.data());
+}
+
+static void BenchParseOptions(void *, long long iters)
+{
+	static const wchar_t *args[] = {
+		L"-monitor", L"2", L"-geometry", L"300x200+2000+700",
+	};
+	struct EyesOptions opt;
+
+	for (long long i = 0; i < iters; i++) {
+		EyesParseOptions(4, (wchar_t **)args, &opt);
+		g_sink += opt.geometryXoff + opt.monitorNumber;
+	}
+}
+
+//
+// Pupil drawing: building the sub-pixel atlas once, rasterizing the
+// pupil on every update, and blitting a sprite from the atlas.
+//
+#define BENCH_PHASES 4
+
+struct PupilCtx {
+	struct EyesPoint ebsize;
+	int w;
+	int h;
+	std::vector<uint32_t> atlas;
+	std::vector<uint32_t> frame;
+};
+
+static void PupilCtxInit(struct PupilCtx *c, const struct SizeParam *sp)
+{
+	struct EyesLayout layout;
+
+	EyesComputeLayout(sp->width, sp->height, &layout);
+	c->ebsize = layout.eyeballsize;
+	c->w = c->ebsize.x * 2 + 2;
+	c->h = c->ebsize.y * 2 + 2;
+	c->atlas.assign((size_t)c->w * c->h * BENCH_PHASES * BENCH_PHASES, 0);
+	c->frame.assign((size_t)c->w * 2 * c->h * 2, 0);
+}
+
+static void BenchAtlasBuild(void *ctx, long long iters)
+{
+	struct PupilCtx *c = (struct PupilCtx *)ctx;
+	int stride = c->w * BENCH_PHASES;
+
+	for (long long i = 0; i < iters; i++) {
+		for (int py = 0; py < BENCH_PHASES; py++) {
+			for (int px = 0; px < BENCH_PHASES; px++) {
+				EyesRasterizePupil(c->atlas.data() + (size_t)py * c->h * stride + px * c->w, stride,
+					c->w, c->h, c->ebsize.x + 1 + (double)px / BENCH_PHASES,
+					c->ebsize.y + 1 + (double)py / BENCH_PHASES, c->ebsize.x, c->ebsize.y);
+			}
+		}
+		g_sink += c->atlas[0];
+	}
+}
+
+static void BenchPupilDirect(void *ctx, long long iters)
+{
+	struct PupilCtx *c = (struct PupilCtx *)ctx;
+	int stride = c->w * 2;
+
+	for (long long i = 0; i < iters; i++) {
+		double f = (double)(i & 255) / 256;
+		EyesRasterizePupil(c->frame.data(), stride, c->w, c->h,
+			c->ebsize.x + 1 + f, c->ebsize.y + 1 + f, c->ebsize.x, c->ebsize.y);
+		g_sink += c->frame[0];
+	}
+}
+
+static void BenchPupilBlit(void *ctx, long long iters)
+{
+	struct PupilCtx *c = (struct PupilCtx *)ctx;
+	int stride = c->w * 2;
+	int astride = c->w * BENCH_PHASES;
+
+	for (long long i = 0; i < iters; i++) {
+		int x, y, px, py;
+		const uint32_t *src;
+		uint32_t *dst;
+
+		EyesQuantizePhase((int)(i & 1023), BENCH_PHASES, &x, &px);
+		EyesQuantizePhase((int)((i >> 3) & 1023), BENCH_PHASES, &y, &py);
+		src = c->atlas.data() + (size_t)py * c->h * astride + px * c->w;
+		dst = c->frame.data() + (size_t)y * stride + x;
+		for (int row = 0; row < c->h; row++)
+			memcpy(dst + (size_t)row * stride, src + (size_t)row * astride, c->w * sizeof(uint32_t));
+		g_sink += c->frame[0];
+	}
+}
+
+//
+// Headless window.
+// The effects are carried out as Windows does: moving and resizing the
+// window send WM_MOVE and WM_SIZE at once, and WM_PAINT is delivered
+// when the message queue becomes empty.
+//
+struct SimWindow {
+	struct EyesState st;
+	struct EyesRect window;
+	bool invalid;
+	long long events;
+	long long effects[NUM_EFFECTS];
+	long long redundant;    // Invalidating an invalid window, or moving to the same place
+};
+
+//
+// Scenario event. For EV_MOUSEMOVE and EV_LBUTTONDOWN, pos is the cursor
+// in screen coordinates. For EV_SIZE, pos is the new client size.
+// The window frame is not simulated, so the window size is the client
+// size.
+//
+struct SimEvent {
+	enum EyesEventType type;
+	struct EyesPoint pos;
+};
+
+static void SimInit(struct SimWindow *w)
+{
+	memset(w, 0, sizeof(*w));
+	EyesStateInit(&w->st);
+	w->window.right = DEFAULT_W;
+	w->window.bottom = DEFAULT_H;
+}
+
+static void SimDispatch(struct SimWindow *w, const struct EyesEvent *ev)
+{
+	struct EyesEffect effects[EYES_MAX_EFFECTS];
+	int n = EyesStateHandle(&w->st, ev, effects);
+
+	w->events++;
+	for (int i = 0; i < n; i++) {
+		const struct EyesEffect *ef = &effects[i];
+		struct EyesEvent next;
+
+		w->effects[ef->type]++;
+		memset(&next, 0, sizeof(next));
+
+		switch (ef->type) {
+		case EF_REDRAW:
+			if (w->invalid)
+				w->redundant++;
+			w->invalid = true;
+			break;
+
+		case EF_PAINT:
+			w->invalid = false;
+			break;
+
+		case EF_MOVE_WINDOW:
+			if (ef->rect.left == w->window.left && ef->rect.top == w->window.top) {
+				w->redundant++;
+				break;
+			}
+			w->window = ef->rect;
+			next.type = EV_MOVE;
+			SimDispatch(w, &next);
+			break;
+
+		case EF_RESIZE_CLIENT:
+			if (ef->rect.right == w->window.right - w->window.left &&
+				ef->rect.bottom == w->window.bottom - w->window.top)
+				break;
+			w->window.right = w->window.left + ef->rect.right;
+			w->window.bottom = w->window.top + ef->rect.bottom;
+			next.type = EV_SIZE;
+			SimDispatch(w, &next);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+static void SimPost(struct SimWindow *w, const struct SimEvent *se)
+{
+	struct EyesEvent ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = se->type;
+	ev.window = w->window;
+	switch (se->type) {
+	case EV_MOUSEMOVE:
+	case EV_LBUTTONDOWN:
+		ev.pos.x = se->pos.x - w->window.left;
+		ev.pos.y = se->pos.y - w->window.top;
+		break;
+
+	case EV_SIZE:
+		w->window.right = w->window.left + se->pos.x;
+		w->window.bottom = w->window.top + se->pos.y;
+		ev.window = w->window;
+		break;
+
+	case EV_DEFAULT_SIZE:
+		ev.pos.x = w->window.right - w->window.left;
+		ev.pos.y = w->window.bottom - w->window.top;
+		break;
+
+	default:
+		break;
+	}
+	SimDispatch(w, &ev);
+
+	if (w->invalid) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = EV_PAINT;
+		SimDispatch(w, &ev);
+	}
+}
+
+static void SimAdd(std::vector<struct SimEvent> &v, enum EyesEventType type, int x, int y)
+{
+	struct SimEvent se;
+
+	se.type = type;
+	se.pos.x = x;
+	se.pos.y = y;
+	v.push_back(se);
+}
+
+//
+// Dragging the window around with small cursor steps.
+//
+static void ScenarioDrag(std::vector<struct SimEvent> &v)
+{
+	SimAdd(v, EV_LBUTTONDOWN, 40, 30);
+	for (int i = 0; i < 1000; i++)
+		SimAdd(v, EV_MOUSEMOVE, 40 + i % 300, 30 + (i * 7) % 200);
+	SimAdd(v, EV_LBUTTONUP, 0, 0);
+}
+
+//
+// Double-clicking the eyes repeatedly.
+//
+static void ScenarioDoubleClick(std::vector<struct SimEvent> &v)
+{
+	for (int i = 0; i < 1000; i++) {
+		SimAdd(v, EV_LBUTTONDOWN, 50, 50);
+		SimAdd(v, EV_LBUTTONUP, 0, 0);
+		SimAdd(v, EV_TOGGLE_MENU, 0, 0);
+		SimAdd(v, EV_LBUTTONUP, 0, 0);
+	}
+}
+
+//
+// Resizing the window frame.
+//
+static void ScenarioResize(std::vector<struct SimEvent> &v)
+{
+	for (int i = 0; i < 1000; i++)
+		SimAdd(v, EV_SIZE, 150 + i % 400, 100 + i % 300);
+}
+
+//
+// Selecting "Default Size" after resizing, and once more without resizing.
+//
+static void ScenarioDefaultSize(std::vector<struct SimEvent> &v)
+{
+	for (int i = 0; i < 500; i++) {
+		SimAdd(v, EV_SIZE, 300 + i % 100, 200);
+		SimAdd(v, EV_DEFAULT_SIZE, 0, 0);
+		SimAdd(v, EV_DEFAULT_SIZE, 0, 0);
+	}
+}
+
+struct ReplayCtx {
+	struct SimWindow w;
+	std::vector<struct SimEvent> events;
+};
+
+static void BenchReplay(void *ctx, long long iters)
+{
+	struct ReplayCtx *c = (struct ReplayCtx *)ctx;
+	size_t n = c->events.size();
+
+	for (long long i = 0; i < iters; i++)
+		SimPost(&c->w, &c->events[i % n]);
+	g_sink += c->w.events;
+}
+
+static void ReportEffects(const char *param, const std::vector<struct SimEvent> &events)
+{
+	struct SimWindow w;
+
+	if (g_filter && strstr("state_effects", g_filter) == NULL)
+		return;
+
+	SimInit(&w);
+	for (const struct SimEvent &se : events)
+		SimPost(&w, &se);
+
+	printf("{\"kernel\":\"state_effects\",\"param\":\"%s\",\"events\":%lld,"
+		"\"set_region\":%lld,\"paint\":%lld,\"redraw\":%lld,\"move_window\":%lld,"
+		"\"resize_client\":%lld,\"redundant\":%lld}\n",
+		param, w.events, w.effects[EF_SET_REGION], w.effects[EF_PAINT], w.effects[EF_REDRAW],
+		w.effects[EF_MOVE_WINDOW], w.effects[EF_RESIZE_CLIENT], w.redundant);
+	fflush(stdout);
+}
+
+//
+// Flight recorder.
+// A synthetic recording of the mouse hook at 1000Hz: the cursor glides
+// in strokes with pauses, each sample is followed by an update, and the
+// face is painted now and then. The ticks are 10MHz like the
+// performance counter.
+//
+#define FLIGHT_TICKS_PER_MS 10000ULL
+
+static void FlightTrace(std::vector<struct FlightEvent> &v, int samples)
+{
+	struct FlightEvent ev;
+	uint64_t time = 1000000000ULL;
+	double x = 800, y = 600, vx = 0, vy = 0;
+	uint32_t seed = 12345;
+
+	memset(&ev, 0, sizeof(ev));
+	for (int i = 0; i < samples; i++) {
+		int phase = i % 1500;
+
+		if (phase == 0) {
+			seed = seed * 1103515245 + 12345;
+			vx = (double)((int)(seed >> 16) % 13 - 6) * 0.7;
+			seed = seed * 1103515245 + 12345;
+			vy = (double)((int)(seed >> 16) % 9 - 4) * 0.7;
+		}
+		time += FLIGHT_TICKS_PER_MS + (i % 7) * 13;
+		if (phase < 900) {
+			x += vx;
+			y += vy;
+		}
+
+		ev.time = time;
+		ev.x = (int32_t)x;
+		ev.y = (int32_t)y;
+		ev.hookTime = (uint32_t)(time / FLIGHT_TICKS_PER_MS);
+		ev.type = FR_CURSOR;
+		v.push_back(ev);
+
+		ev.time = time + 2000;
+		ev.type = (phase < 900) ? FR_UPDATE : FR_UPDATE_SKIP;
+		v.push_back(ev);
+
+		if (i % 5000 == 0) {
+			ev.time = time + 4000;
+			ev.type = FR_PAINT;
+			v.push_back(ev);
+		}
+	}
+}
+
+struct FlightCtx {
+	std::vector<struct FlightEvent> events;
+	std::vector<uint8_t> file;
+	struct FlightWriter writer;
+	struct FlightRing *ring;
+};
+
+static void FlightCtxInit(struct FlightCtx *c)
+{
+	void *mem = EyesAlignedAlloc(sizeof(struct FlightRing), alignof(struct FlightRing));
+
+	if (mem == NULL)
+		abort();
+	FlightTrace(c->events, 60000);
+	c->file.resize(FlightFileSize(4 * 1024 * 1024));
+	FlightWriterInit(&c->writer, c->file.data(), c->file.size(), FLIGHT_TICKS_PER_MS * 1000);
+	c->ring = new (mem) struct FlightRing;
+	FlightRingInit(c->ring);
+}
+
+//
+// Push on the hook path, drained in batches as the recorder thread does.
+//
+static void BenchFlightRing(void *ctx, long long iters)
+{
+	struct FlightCtx *c = (struct FlightCtx *)ctx;
+	struct FlightEvent out[256];
+	size_t n = c->events.size();
+
+	for (long long i = 0; i < iters; i++) {
+		if (!FlightRingPush(c->ring, &c->events[i % n])) {
+			g_sink += FlightRingPop(c->ring, out, 256);
+			FlightRingPush(c->ring, &c->events[i % n]);
+		}
+	}
+	while (FlightRingPop(c->ring, out, 256) > 0)
+		;
+}
+
+static void BenchFlightEncode(void *ctx, long long iters)
+{
+	struct FlightCtx *c = (struct FlightCtx *)ctx;
+	long long n = (long long)c->events.size();
+
+	for (long long i = 0; i < iters; i += 256) {
+		long long start = i % n;
+		long long count = 256;
+
+		if (count > n - start)
+			count = n - start;
+		if (count > iters - i)
+			count = iters - i;
+		FlightWriterAppend(&c->writer, &c->events[(size_t)start], (int)count);
+	}
+}
+
+static void CountEvent(void *ctx, const struct FlightEvent *ev)
+{
+	(*(long long *)ctx) += ev->x;
+}
+
+static void BenchFlightDecode(void *ctx, long long iters)
+{
+	struct FlightCtx *c = (struct FlightCtx *)ctx;
+	long long done = 0, sum = 0;
+
+	while (done < iters)
+		done += FlightDecode(c->file.data(), c->file.size(), NULL, CountEvent, &sum);
+	g_sink += sum;
+}
+
+static void ReportFlightRatio(const char *param)
+{
+	struct FlightCtx c;
+	long long decoded;
+	uint64_t used = 0;
+
+	if (g_filter && strstr("flight_ratio", g_filter) == NULL)
+		return;
+
+	//
+	// The file is large enough that no segment is overwritten.
+	//
+	FlightTrace(c.events, 60000);
+	c.file.resize(FlightFileSize(c.events.size() * sizeof(struct FlightEvent)));
+	FlightWriterInit(&c.writer, c.file.data(), c.file.size(), FLIGHT_TICKS_PER_MS * 1000);
+	FlightWriterAppend(&c.writer, c.events.data(), (int)c.events.size());
+	//
+	// Storage used including the segment headers and the unused tails.
+	//
+	used = (uint64_t)c.writer.segment * FLIGHT_SEGMENT_SIZE + c.writer.pos;
+	decoded = FlightDecode(c.file.data(), c.file.size(), NULL, NULL, NULL);
+
+	printf("{\"kernel\":\"flight_ratio\",\"param\":\"%s\",\"events\":%zu,\"decoded\":%lld,"
+		"\"raw_bytes\":%zu,\"encoded_bytes\":%llu,\"bytes_per_event\":%.3f,\"ratio\":%.2f}\n",
+		param, c.events.size(), decoded, c.events.size() * sizeof(struct FlightEvent),
+		(unsigned long long)used, (double)used / c.events.size(),
+		(double)(c.events.size() * sizeof(struct FlightEvent)) / used);
+	fflush(stdout);
+}
+
+//
+// Tile renderer.
+//
+static const struct SizeParam g_paintSizes[] = {
+	{ 1920, 1080, "1920x1080" },
+	{ 3840, 2160, "3840x2160" },
+	{ 7680, 4320, "7680x4320" },
+};
+
+struct PaintCtx {
+	struct EyesTilePool *pool;
+	struct EyesFrame frame;
+	struct EyesLayout layout;
+	struct EyesRect damage;
+	bool whole;
+	std::vector<uint32_t> bits;
+};
+
+static void BenchPaint(void *ctx, long long iters)
+{
+	struct PaintCtx *c = (struct PaintCtx *)ctx;
+
+	for (long long i = 0; i < iters; i++)
+		g_sink += EyesPaintFace(c->pool, &c->frame, &c->layout, c->whole ? NULL : &c->damage);
+}
+
+static void PaintBenches(void)
+{
+	std::vector<int> threads;
+	int maxThreads = (int)std::thread::hardware_concurrency();
+
+	if (g_filter && strstr("paint_tiles", g_filter) == NULL && strstr("paint_damage", g_filter) == NULL)
+		return;
+
+	//
+	// At least up to 8 threads, so that the overhead of the pool is
+	// shown on a machine of fewer processors too.
+	//
+	if (maxThreads < 8)
+		maxThreads = 8;
+	if (maxThreads > MAX_THREADS)
+		maxThreads = MAX_THREADS;
+	for (int t = 1; t < maxThreads; t *= 2)
+		threads.push_back(t);
+	threads.push_back(maxThreads);
+
+	for (const struct SizeParam &sp : g_paintSizes) {
+		struct PaintCtx c;
+
+		c.bits.resize((size_t)sp.width * sp.height);
+		c.frame.bits = c.bits.data();
+		c.frame.stride = sp.width;
+		c.frame.width = sp.width;
+		c.frame.height = sp.height;
+		EyesComputeLayout(sp.width, sp.height, &c.layout);
+
+		for (int t : threads) {
+			char param[64];
+
+			c.pool = EyesTilePoolCreate(t);
+			snprintf(param, sizeof(param), "%s/t%d", sp.name, t);
+
+			c.whole = true;
+			RunBench("paint_tiles", param, BenchPaint, &c);
+
+			//
+			// A pupil sized damage over the left eye.
+			//
+			c.whole = false;
+			c.damage.left = c.layout.center[LEYE].x - c.layout.eyesize.x;
+			c.damage.top = c.layout.center[LEYE].y - c.layout.eyesize.y;
+			c.damage.right = c.damage.left + 2 * c.layout.eyeballsize.x + 2;
+			c.damage.bottom = c.damage.top + 2 * c.layout.eyeballsize.y + 2;
+			RunBench("paint_damage", param, BenchPaint, &c);
+
+			EyesTilePoolFree(c.pool);
+		}
+	}
+}
+
+//
+// Remote mode.
+// The cursor trace is replayed against a CPU framebuffer of the window
+// as the mouse hook does, and the damage of the updates is accounted:
+// damage is the area of the updated rectangles, and changed is the
+// pixels which differ from those the client already has.
+//
+struct TraceSample {
+	long long ms;
+	int x;
+	int y;
+};
+
+static bool LoadTrace(const char *path, std::vector<struct TraceSample> &v)
+{
+	FILE *fp = fopen(path, "r");
+	char line[256];
+
+	if (fp == NULL)
+		return false;
+	while (fgets(line, sizeof(line), fp)) {
+		struct TraceSample ts;
+
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%lld %d %d", &ts.ms, &ts.x, &ts.y) == 3)
+			v.push_back(ts);
+	}
+	fclose(fp);
+	return true;
+}
+
+static void SyntheticTrace(std::vector<struct TraceSample> &v)
+{
+	std::vector<struct FlightEvent> events;
+
+	FlightTrace(events, 60000);
+	for (const struct FlightEvent &ev : events) {
+		struct TraceSample ts;
+
+		if (ev.type != FR_CURSOR)
+			continue;
+		ts.ms = (long long)(ev.time / FLIGHT_TICKS_PER_MS);
+		ts.x = ev.x;
+		ts.y = ev.y;
+		v.push_back(ts);
+	}
+}
+
+struct RemoteSim {
+	struct EyesTilePool *pool;
+	struct EyesFrame frame;
+	std::vector<uint32_t> bits;
+	std::vector<uint32_t> client;   // Pixels the client has
+	struct EyesLayout layout;
+	struct EyesPoint origin;        // Window position on the screen
+	bool remote;
+	struct EyesBudget budget;
+	long long timer;                // Time of the retry, or -1
+	struct TraceSample cursor;      // Last cursor position
+	bool drawn;
+	struct EyesPoint pupil[NUM_EYES];
+	struct EyesRect rect[NUM_EYES];
+	long long updates;
+	long long damage;               // Bytes of the damaged cells
+	long long charged;              // Bytes charged to the budget
+	long long changed;
+};
+
+static void ClipRect(struct EyesRect *r, int width, int height)
+{
+	r->left = std::max(r->left, 0);
+	r->top = std::max(r->top, 0);
+	r->right = std::min(r->right, width);
+	r->bottom = std::min(r->bottom, height);
+}
+
+//
+// Send the rectangle to the client, and count the changed pixels.
+//
+static void SimSend(struct RemoteSim *sim, struct EyesRect r)
+{
+	ClipRect(&r, sim->frame.width, sim->frame.height);
+	for (int y = r.top; y < r.bottom; y++) {
+		for (int x = r.left; x < r.right; x++) {
+			size_t i = (size_t)y * sim->frame.stride + x;
+			if (sim->client[i] != sim->bits[i]) {
+				sim->client[i] = sim->bits[i];
+				sim->changed += REMOTE_BYTES_PER_PIXEL;
+			}
+		}
+	}
+}
+
+static void SimDrawPupils(struct RemoteSim *sim, const struct EyesPoint pupil[NUM_EYES],
+	long long damage, long long cost)
+{
+	struct EyesRect next[NUM_EYES];
+
+	for (int i = 0; i < NUM_EYES; i++) {
+		if (sim->drawn)
+			EyesPaintFace(sim->pool, &sim->frame, &sim->layout, &sim->rect[i]);
+		next[i] = EyesPupilRect(pupil[i], sim->layout.eyeballsize);
+	}
+	for (int i = 0; i < NUM_EYES; i++) {
+		struct EyesRect r = next[i];
+
+		ClipRect(&r, sim->frame.width, sim->frame.height);
+		if (r.left >= r.right || r.top >= r.bottom)
+			continue;
+		EyesRasterizePupil(sim->bits.data() + (size_t)r.top * sim->frame.stride + r.left,
+			sim->frame.stride, r.right - r.left, r.bottom - r.top,
+			(double)pupil[i].x / SUBPIXEL_ONE - r.left, (double)pupil[i].y / SUBPIXEL_ONE - r.top,
+			sim->layout.eyeballsize.x, sim->layout.eyeballsize.y);
+	}
+	for (int i = 0; i < NUM_EYES; i++) {
+		if (sim->drawn)
+			SimSend(sim, sim->rect[i]);
+		SimSend(sim, next[i]);
+		sim->rect[i] = next[i];
+		sim->pupil[i] = pupil[i];
+	}
+	sim->drawn = true;
+	sim->updates++;
+	sim->damage += damage;
+	sim->charged += cost;
+}
+
+static void SimUpdate(struct RemoteSim *sim, const struct TraceSample *ts, long long now)
+{
+	struct EyesPoint mouseloc, pupil[NUM_EYES];
+	struct EyesRect next[NUM_EYES];
+	long long damage, cost;
+
+	//
+	// The eyes are not updated while the cursor stays, except by the
+	// retry of the timer.
+	//
+	if (sim->drawn && now == ts->ms && ts->x == sim->cursor.x && ts->y == sim->cursor.y)
+		return;
+	sim->cursor = *ts;
+
+	mouseloc.x = ts->x - sim->origin.x;
+	mouseloc.y = ts->y - sim->origin.y;
+	EyesLookAt(mouseloc, &sim->layout, pupil);
+
+	if (sim->remote)
+		EyesBudgetQuantize(&sim->budget, &sim->layout, pupil);
+	for (int i = 0; i < NUM_EYES; i++)
+		next[i] = EyesPupilRect(pupil[i], sim->layout.eyeballsize);
+	damage = EyesPupilDamage(sim->rect, next);
+	cost = EyesPupilChange(sim->drawn ? sim->pupil : NULL, pupil, sim->layout.eyeballsize);
+
+	if (sim->remote) {
+		if (sim->drawn && memcmp(pupil, sim->pupil, sizeof(sim->pupil)) == 0) {
+			sim->budget.pending = false;
+			sim->timer = -1;
+			return;
+		}
+		int wait = EyesBudgetRequest(&sim->budget, now, cost);
+		if (wait > 0) {
+			sim->timer = now + wait;
+			return;
+		}
+		sim->timer = -1;
+	}
+	SimDrawPupils(sim, pupil, damage, cost);
+}
+
+static void ReportRemote(const char *name, const std::vector<struct TraceSample> &trace,
+	const struct SizeParam *sp, struct EyesPoint origin, bool remote)
+{
+	struct RemoteSim sim;
+	struct EyesPoint mouseloc, last[NUM_EYES];
+	long long start, seconds1000;
+	size_t i = 0;
+
+	if (trace.empty())
+		return;
+
+	sim.pool = EyesTilePoolCreate(1);
+	sim.bits.resize((size_t)sp->width * sp->height);
+	sim.frame.bits = sim.bits.data();
+	sim.frame.stride = sp->width;
+	sim.frame.width = sp->width;
+	sim.frame.height = sp->height;
+	EyesComputeLayout(sp->width, sp->height, &sim.layout);
+	EyesPaintFace(sim.pool, &sim.frame, &sim.layout, NULL);
+	sim.client = sim.bits;
+	sim.origin = origin;
+	sim.remote = remote;
+	start = trace[0].ms;
+	EyesBudgetInit(&sim.budget, DEFAULT_REMOTE_FPS, DEFAULT_REMOTE_KBPS * 1024, DEFAULT_REMOTE_GRID, start);
+	sim.timer = -1;
+	sim.drawn = false;
+	memset(sim.rect, 0, sizeof(sim.rect));
+	sim.updates = sim.damage = sim.charged = sim.changed = 0;
+
+	//
+	// The retry of the timer is run with the latest cursor position.
+	//
+	while (i < trace.size() || sim.timer >= 0) {
+		if (sim.timer >= 0 && (i == trace.size() || sim.timer <= trace[i].ms)) {
+			long long now = sim.timer;
+			sim.timer = -1;
+			SimUpdate(&sim, &trace[i - 1], now);
+			continue;
+		}
+		SimUpdate(&sim, &trace[i], trace[i].ms);
+		i++;
+	}
+
+	//
+	// The pupils rest where the cursor is.
+	//
+	mouseloc.x = trace.back().x - origin.x;
+	mouseloc.y = trace.back().y - origin.y;
+	EyesLookAt(mouseloc, &sim.layout, last);
+	if (remote)
+		EyesBudgetQuantize(&sim.budget, &sim.layout, last);
+
+	//
+	// The final update may be sent after the trace ends.
+	//
+	seconds1000 = std::max(std::max(trace.back().ms, sim.budget.lastSent) - start, 1LL);
+	printf("{\"kernel\":\"remote_damage\",\"param\":\"%s/%s/%s\",\"seconds\":%.3f,"
+		"\"samples\":%zu,\"updates\":%lld,\"deferred\":%lld,\"updates_per_sec\":%.1f,"
+		"\"damage_bytes_per_sec\":%.0f,\"charged_bytes_per_sec\":%.0f,\"changed_bytes_per_sec\":%.0f,"
+		"\"final\":%s}\n",
+		name, sp->name, remote ? "remote" : "local", seconds1000 / 1000.0,
+		trace.size(), sim.updates, remote ? sim.budget.deferred : 0LL,
+		sim.updates * 1000.0 / seconds1000,
+		sim.damage * 1000.0 / seconds1000, sim.charged * 1000.0 / seconds1000, sim.changed * 1000.0 / seconds1000,
+		memcmp(last, sim.pupil, sizeof(last)) == 0 ? "true" : "false");
+	fflush(stdout);
+	EyesTilePoolFree(sim.pool);
+}
+
+struct BudgetCtx {
+	struct EyesBudget budget;
+	struct EyesLayout layout;
+	std::vector<struct EyesPoint> path;
+};
+
+static void BenchBudget(void *ctx, long long iters)
+{
+	struct BudgetCtx *c = (struct BudgetCtx *)ctx;
+	size_t n = c->path.size();
+
+	for (long long i = 0; i < iters; i++) {
+		struct EyesPoint pupil[NUM_EYES];
+
+		EyesLookAt(c->path[i % n], &c->layout, pupil);
+		EyesBudgetQuantize(&c->budget, &c->layout, pupil);
+		g_sink += EyesBudgetRequest(&c->budget, i, 4096);
+	}
+}
+
+static void RemoteBenches(const char *tracePath)
+{
+	std::vector<struct TraceSample> trace;
+	const char *name = "synthetic";
+	struct EyesPoint origin;
+
+	if (!g_filter || strstr("remote_budget", g_filter)) {
+		struct BudgetCtx c;
+
+		EyesComputeLayout(DEFAULT_W, DEFAULT_H, &c.layout);
+		EyesBudgetInit(&c.budget, DEFAULT_REMOTE_FPS, DEFAULT_REMOTE_KBPS * 1024, DEFAULT_REMOTE_GRID, 0);
+		for (int i = 0; i < 1024; i++) {
+			struct EyesPoint p;
+			p.x = (i * 37) % (DEFAULT_W * 3) - DEFAULT_W;
+			p.y = (i * 53) % (DEFAULT_H * 3) - DEFAULT_H;
+			c.path.push_back(p);
+		}
+		RunBench("remote_budget", "150x100", BenchBudget, &c);
+	}
+
+	if (g_filter && strstr("remote_damage", g_filter) == NULL)
+		return;
+
+	if (tracePath) {
+		if (!LoadTrace(tracePath, trace)) {
+			fprintf(stderr, "%s: cannot read\n", tracePath);
+			return;
+		}
+		name = "trace";
+	}
+	else {
+		SyntheticTrace(trace);
+	}
+
+	//
+	// A default window near the cursor, and a full screen one.
+	//
+	origin.x = 700;
+	origin.y = 500;
+	ReportRemote(name, trace, &g_sizes[0], origin, false);
+	ReportRemote(name, trace, &g_sizes[0], origin, true);
+	origin.x = 0;
+	origin.y = 0;
+	ReportRemote(name, trace, &g_sizes[1], origin, false);
+	ReportRemote(name, trace, &g_sizes[1], origin, true);
+}
+
+//
+// Export.
+// The frames of the cursor trace are rendered by worker threads into a
+// reorder buffer of two slots per thread and written out in order, as
+// wineyes_export.cpp does. The GDI drawing of the export is replaced by
+// the tile renderer and the pupil rasterizer of the core, so that the
+// scaling with the threads can be measured on Linux.
+//
+#define EXPORT_SLOTS_PER_THREAD 2
+
+struct ExportSim {
+	const std::vector<struct TraceSample> *trace;
+	int width;
+	int height;
+	int fps;
+	int nframes;
+	size_t frameBytes;
+
+	int slots;
+	std::vector<uint8_t> buffer;
+	std::vector<char> ready;
+	int next;
+	int written;
+	std::mutex lock;
+	std::condition_variable cond;
+};
+
+static const struct TraceSample *ExportSample(const struct ExportSim *sim, long long t)
+{
+	const std::vector<struct TraceSample> &v = *sim->trace;
+	size_t lo = 0, hi = v.size() - 1;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		if (v[mid].ms <= t)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return &v[lo];
+}
+
+//
+// BT.601 limited range, 4:4:4 planar, as ConvertFrame() of the export.
+//
+static void ExportConvert(const uint32_t *bits, int npixels, uint8_t *out)
+{
+	uint8_t *y, *u, *v;
+
+	memcpy(out, "FRAME\n", 6);
+	y = out + 6;
+	u = y + npixels;
+	v = u + npixels;
+	for (int i = 0; i < npixels; i++) {
+		int b = bits[i] & 0xff;
+		int g = (bits[i] >> 8) & 0xff;
+		int r = (bits[i] >> 16) & 0xff;
+		y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		u[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		v[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+}
+
+static void ExportWorker(struct ExportSim *sim)
+{
+	struct EyesTilePool *pool = EyesTilePoolCreate(1);
+	std::vector<uint32_t> bits((size_t)sim->width * sim->height);
+	struct EyesFrame frame = { bits.data(), sim->width, sim->width, sim->height };
+	struct EyesLayout layout;
+
+	EyesComputeLayout(sim->width, sim->height, &layout);
+	for (;;) {
+		const struct TraceSample *ts;
+		struct EyesPoint mouseloc, pupil[NUM_EYES];
+		int n;
+
+		{
+			std::unique_lock<std::mutex> lk(sim->lock);
+
+			sim->cond.wait(lk, [&] { return sim->next >= sim->nframes || sim->next < sim->written + sim->slots; });
+			if (sim->next >= sim->nframes)
+				break;
+			n = sim->next++;
+		}
+
+		ts = ExportSample(sim, (*sim->trace)[0].ms + (long long)n * 1000 / sim->fps);
+		mouseloc.x = ts->x;
+		mouseloc.y = ts->y;
+		EyesPaintFace(pool, &frame, &layout, NULL);
+		EyesLookAt(mouseloc, &layout, pupil);
+		for (int i = 0; i < NUM_EYES; i++) {
+			struct EyesRect r = EyesPupilRect(pupil[i], layout.eyeballsize);
+
+			ClipRect(&r, sim->width, sim->height);
+			if (r.left >= r.right || r.top >= r.bottom)
+				continue;
+			EyesRasterizePupil(bits.data() + (size_t)r.top * sim->width + r.left, sim->width,
+				r.right - r.left, r.bottom - r.top,
+				(double)pupil[i].x / SUBPIXEL_ONE - r.left, (double)pupil[i].y / SUBPIXEL_ONE - r.top,
+				layout.eyeballsize.x, layout.eyeballsize.y);
+		}
+		ExportConvert(bits.data(), sim->width * sim->height,
+			sim->buffer.data() + (size_t)(n % sim->slots) * sim->frameBytes);
+
+		{
+			std::lock_guard<std::mutex> lk(sim->lock);
+			sim->ready[n % sim->slots] = 1;
+		}
+		sim->cond.notify_all();
+	}
+	EyesTilePoolFree(pool);
+}
+
+static void ReportExport(const std::vector<struct TraceSample> &trace, const struct SizeParam *sp, int threads)
+{
+	struct ExportSim sim;
+	std::vector<std::thread> workers;
+	long long start, elapsed;
+
+	sim.trace = &trace;
+	sim.width = sp->width;
+	sim.height = sp->height;
+	sim.fps = DEFAULT_FPS;
+	sim.nframes = (int)((trace.back().ms - trace[0].ms) * sim.fps / 1000) + 1;
+	sim.frameBytes = (size_t)sp->width * sp->height * 3 + 6;
+	sim.slots = threads * EXPORT_SLOTS_PER_THREAD;
+	sim.buffer.resize(sim.frameBytes * sim.slots);
+	sim.ready.assign(sim.slots, 0);
+	sim.next = 0;
+	sim.written = 0;
+
+	start = NowNs();
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(ExportWorker, &sim));
+
+	//
+	// The frames are taken in order and discarded.
+	//
+	for (int n = 0; n < sim.nframes; n++) {
+		std::unique_lock<std::mutex> lk(sim.lock);
+
+		sim.cond.wait(lk, [&] { return sim.ready[n % sim.slots] != 0; });
+		g_sink += sim.buffer[(size_t)(n % sim.slots) * sim.frameBytes + 6];
+		sim.ready[n % sim.slots] = 0;
+		sim.written++;
+		lk.unlock();
+		sim.cond.notify_all();
+	}
+	for (std::thread &t : workers)
+		t.join();
+	elapsed = NowNs() - start;
+
+	printf("{\"kernel\":\"export_frames\",\"param\":\"%s/t%d\",\"frames\":%d,\"seconds\":%.3f,"
+		"\"fps\":%.1f,\"buffer_bytes\":%zu}\n",
+		sp->name, threads, sim.nframes, elapsed / 1e9, sim.nframes * 1e9 / elapsed, sim.buffer.size());
+	fflush(stdout);
+}
+
+static void ExportBenches(void)
+{
+	std::vector<struct TraceSample> trace, part;
+
+	if (g_filter && strstr("export_frames", g_filter) == NULL)
+		return;
+
+	//
+	// Two seconds of the synthetic trace.
+	//
+	SyntheticTrace(trace);
+	for (const struct TraceSample &ts : trace) {
+		if (ts.ms - trace[0].ms > 2000)
+			break;
+		part.push_back(ts);
+	}
+	for (int t = 1; t <= 8; t *= 2)
+		ReportExport(part, &g_sizes[1], t);
+}
+
+//
+// Render cache.
+// Startup to the first frame: the cold one computes the layout and the
+// region, paints the face into a surface and blits it, as the tile path
+// does; the warm one maps the cache file, checks it and blits the stored
+// face. Both end with the face in 'screen'. Only the sizes of the tile
+// renderer are cached.
+//
+static const struct SizeParam g_cacheSizes[] = {
+	{ 1920, 1080, "1920x1080" },
+	{ 3840, 2160, "3840x2160" },
+};
+
+struct CacheCtx {
+	struct EyesCacheKey key;
+	struct EyesTilePool *pool;
+	std::vector<uint32_t> surface;
+	std::vector<uint32_t> screen;
+	const char *path;
+};
+
+static void BenchCacheCold(void *ctx, long long iters)
+{
+	struct CacheCtx *c = (struct CacheCtx *)ctx;
+	std::vector<struct EyesSpan> spans((size_t)c->key.height * NUM_EYES);
+	struct EyesLayout layout;
+	struct EyesFrame frame;
+
+	frame.bits = c->surface.data();
+	frame.stride = c->key.width;
+	frame.width = c->key.width;
+	frame.height = c->key.height;
+	for (long long i = 0; i < iters; i++) {
+		EyesComputeLayout(c->key.width, c->key.height, &layout);
+		g_sink += EyesRegionSpans(&layout, c->key.height, spans.data());
+		g_sink += EyesPaintFace(c->pool, &frame, &layout, NULL);
+		memcpy(c->screen.data(), c->surface.data(), c->screen.size() * sizeof(uint32_t));
+	}
+}
+
+#ifndef _WIN32
+static uint8_t *MapFile(const char *path, size_t size, bool write, int *fd)
+{
+	void *p;
+
+	*fd = open(path, write ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (*fd < 0)
+		return NULL;
+	if (write && ftruncate(*fd, (off_t)size) != 0) {
+		close(*fd);
+		return NULL;
+	}
+	p = mmap(NULL, size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, *fd, 0);
+	if (p == MAP_FAILED) {
+		close(*fd);
+		return NULL;
+	}
+	return (uint8_t *)p;
+}
+
+static void BenchCacheWarm(void *ctx, long long iters)
+{
+	struct CacheCtx *c = (struct CacheCtx *)ctx;
+
+	for (long long i = 0; i < iters; i++) {
+		struct EyesCache cache;
+		struct stat st;
+		uint8_t *base;
+		int fd;
+
+		fd = open(c->path, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) != 0)
+			return;
+		close(fd);
+		base = MapFile(c->path, (size_t)st.st_size, false, &fd);
+		if (base == NULL)
+			return;
+		if (EyesCacheOpen(base, (size_t)st.st_size, &c->key, &cache) &&
+			EyesCacheCheckRows(&cache, 0, c->key.height)) {
+			g_sink += cache.nspans + cache.spans[0].x0;
+			memcpy(c->screen.data(), cache.bits, c->screen.size() * sizeof(uint32_t));
+		}
+		munmap(base, (size_t)st.st_size);
+		close(fd);
+	}
+}
+
+//
+// Opening and mapping a file of the header and the spans of a small
+// window, which is the least that a cache of its region would cost.
+//
+static void BenchCacheMap(void *ctx, long long iters)
+{
+	struct CacheCtx *c = (struct CacheCtx *)ctx;
+
+	for (long long i = 0; i < iters; i++) {
+		struct stat st;
+		uint8_t *base;
+		int fd;
+
+		fd = open(c->path, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) != 0)
+			return;
+		close(fd);
+		base = MapFile(c->path, (size_t)st.st_size, false, &fd);
+		if (base == NULL)
+			return;
+		g_sink += base[CACHE_HEADER_BYTES];
+		munmap(base, (size_t)st.st_size);
+		close(fd);
+	}
+}
+
+static void BenchCacheBuild(void *ctx, long long iters)
+{
+	struct CacheCtx *c = (struct CacheCtx *)ctx;
+	size_t size = EyesCacheFileSize(&c->key);
+
+	for (long long i = 0; i < iters; i++) {
+		int fd;
+		uint8_t *base = MapFile(c->path, size, true, &fd);
+
+		if (base == NULL)
+			return;
+		g_sink += EyesCacheBuild(base, size, &c->key, c->pool);
+		munmap(base, size);
+		close(fd);
+	}
+}
+#endif
+
+static void CacheBenches(void)
+{
+	struct EyesTilePool *pool;
+
+	if (g_filter && strstr("cache_cold", g_filter) == NULL && strstr("cache_warm", g_filter) == NULL &&
+		strstr("cache_build", g_filter) == NULL && strstr("cache_map", g_filter) == NULL)
+		return;
+
+#ifndef _WIN32
+	{
+		struct EyesLayout layout;
+		struct CacheCtx c;
+		char path[64];
+		size_t size;
+		uint8_t *base;
+		int fd;
+
+		snprintf(path, sizeof(path), "/tmp/wineyes_bench.%d.xerc", (int)getpid());
+		c.path = path;
+		size = CACHE_HEADER_BYTES + (size_t)DEFAULT_H * NUM_EYES * sizeof(struct EyesSpan);
+		base = MapFile(path, size, true, &fd);
+		if (base) {
+			EyesComputeLayout(DEFAULT_W, DEFAULT_H, &layout);
+			EyesRegionSpans(&layout, DEFAULT_H, (struct EyesSpan *)(base + CACHE_HEADER_BYTES));
+			munmap(base, size);
+			close(fd);
+			RunBench("cache_map", "150x100", BenchCacheMap, &c);
+		}
+		unlink(path);
+	}
+#endif
+
+	pool = EyesTilePoolCreate(0);
+	for (const struct SizeParam &sp : g_cacheSizes) {
+		struct CacheCtx c;
+		char param[64];
+
+		c.key.width = sp.width;
+		c.key.height = sp.height;
+		c.pool = pool;
+		c.surface.resize((size_t)sp.width * sp.height);
+		c.screen.resize((size_t)sp.width * sp.height);
+		snprintf(param, sizeof(param), "%s/t%d", sp.name, EyesTilePoolThreads(pool));
+		RunBench("cache_cold", param, BenchCacheCold, &c);
+#ifndef _WIN32
+		{
+			char path[64];
+
+			snprintf(path, sizeof(path), "/tmp/wineyes_bench.%d.xerc", (int)getpid());
+			c.path = path;
+			RunBench("cache_build", param, BenchCacheBuild, &c);
+			RunBench("cache_warm", param, BenchCacheWarm, &c);
+			unlink(path);
+		}
+#endif
+	}
+	EyesTilePoolFree(pool);
+}
+
+//
+// Launch forwarding.
+// The message of a second launch is encoded, passed to the running
+// instance over a local socket, which stands in for WM_COPYDATA, and
+// decoded into the options there.
+//
+static const wchar_t *g_launchArgs[] = {
+	L"-monitor", L"2", L"-geometry", L"300x200+2000+700", L"-remote",
+};
+#define LAUNCH_ARGS ((int)(sizeof(g_launchArgs) / sizeof(g_launchArgs[0])))
+
+struct LaunchCtx {
+	uint8_t msg[LAUNCH_MAX_BYTES];
+	size_t bytes;
+	int sv[2];
+};
+
+static void BenchLaunchEncode(void *ctx, long long iters)
+{
+	struct LaunchCtx *c = (struct LaunchCtx *)ctx;
+
+	for (long long i = 0; i < iters; i++)
+		g_sink += EyesLaunchEncode(LAUNCH_ARGS, (wchar_t **)g_launchArgs, c->msg, sizeof(c->msg));
+}
+
+static void BenchLaunchDecode(void *ctx, long long iters)
+{
+	struct LaunchCtx *c = (struct LaunchCtx *)ctx;
+	struct EyesOptions opt;
+
+	for (long long i = 0; i < iters; i++) {
+		EyesLaunchDecode(c->msg, c->bytes, &opt);
+		g_sink += opt.geometryXoff + opt.monitorNumber;
+	}
+}
+
+#ifndef _WIN32
+static bool WriteAll(int fd, const uint8_t *p, size_t n)
+{
+	while (n > 0) {
+		ssize_t r = write(fd, p, n);
+		if (r <= 0)
+			return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+static bool ReadAll(int fd, uint8_t *p, size_t n)
+{
+	while (n > 0) {
+		ssize_t r = read(fd, p, n);
+		if (r <= 0)
+			return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+//
+// Receive a message and acknowledge it, as WM_COPYDATA returns TRUE
+// after the window is opened.
+//
+static bool LaunchServe(int fd, struct EyesOptions *opt)
+{
+	uint8_t msg[LAUNCH_MAX_BYTES];
+	size_t bytes;
+	uint8_t ack;
+
+	if (!ReadAll(fd, msg, LAUNCH_HEADER_BYTES))
+		return false;
+	bytes = msg[8] | (size_t)msg[9] << 8 | (size_t)msg[10] << 16 | (size_t)msg[11] << 24;
+	if (bytes > LAUNCH_MAX_BYTES - LAUNCH_HEADER_BYTES ||
+		!ReadAll(fd, msg + LAUNCH_HEADER_BYTES, bytes))
+		return false;
+	ack = EyesLaunchDecode(msg, LAUNCH_HEADER_BYTES + bytes, opt) &&
+		EyesLaunchForwardable(opt) ? 1 : 0;
+	return WriteAll(fd, &ack, 1) && ack;
+}
+
+static void BenchLaunchSocket(void *ctx, long long iters)
+{
+	struct LaunchCtx *c = (struct LaunchCtx *)ctx;
+	struct EyesOptions opt;
+	uint8_t ack = 0;
+
+	for (long long i = 0; i < iters; i++) {
+		size_t n = EyesLaunchEncode(LAUNCH_ARGS, (wchar_t **)g_launchArgs, c->msg, sizeof(c->msg));
+
+		WriteAll(c->sv[0], c->msg, n);
+		LaunchServe(c->sv[1], &opt);
+		ReadAll(c->sv[0], &ack, 1);
+		g_sink += ack + opt.geometryXoff;
+	}
+}
+
+//
+// Startup of a new instance which does not depend on Win32: the options,
+// the layout, the window region, the pupil atlas and the first paint.
+//
+static void ColdStart(const struct EyesOptions *opt)
+{
+	struct EyesLayout layout;
+	std::vector<struct EyesSpan> spans((size_t)opt->geometryHeight * NUM_EYES);
+	std::vector<uint32_t> bits((size_t)opt->geometryWidth * opt->geometryHeight);
+	struct EyesTilePool *pool;
+	struct EyesFrame frame;
+	int w, h;
+
+	EyesComputeLayout(opt->geometryWidth, opt->geometryHeight, &layout);
+	g_sink += EyesRegionSpans(&layout, opt->geometryHeight, spans.data());
+
+	w = layout.eyeballsize.x * 2 + 2;
+	h = layout.eyeballsize.y * 2 + 2;
+	std::vector<uint32_t> atlas((size_t)w * h * BENCH_PHASES * BENCH_PHASES);
+	for (int py = 0; py < BENCH_PHASES; py++) {
+		for (int px = 0; px < BENCH_PHASES; px++) {
+			EyesRasterizePupil(atlas.data() + ((size_t)py * h * BENCH_PHASES + px) * w,
+				w * BENCH_PHASES, w, h, layout.eyeballsize.x + 1 + (double)px / BENCH_PHASES,
+				layout.eyeballsize.y + 1 + (double)py / BENCH_PHASES,
+				layout.eyeballsize.x, layout.eyeballsize.y);
+		}
+	}
+
+	pool = EyesTilePoolCreate(0);
+	frame.bits = bits.data();
+	frame.stride = opt->geometryWidth;
+	frame.width = opt->geometryWidth;
+	frame.height = opt->geometryHeight;
+	g_sink += EyesPaintFace(pool, &frame, &layout, NULL);
+	EyesTilePoolFree(pool);
+}
+
+//
+// A launched process: wineyes_bench --launch-child cold|forward SOCKET ARGS...
+// The forwarded one falls back to the cold start if nobody answers.
+//
+static int LaunchChild(int argc, char **argv)
+{
+	std::vector<std::wstring> wargs;
+	std::vector<wchar_t *> wargv;
+	struct EyesOptions opt;
+
+	for (int i = 2; i < argc; i++) {
+		std::wstring ws(strlen(argv[i]), L'\0');
+		ws.resize(mbstowcs(&ws[0], argv[i], ws.size()));
+		wargs.push_back(ws);
+	}
+	for (std::wstring &ws : wargs)
+		wargv.push_back(&ws[0]);
+	EyesParseOptions((int)wargv.size(), wargv.data(), &opt);
+
+	if (strcmp(argv[0], "forward") == 0 && EyesLaunchForwardable(&opt)) {
+		uint8_t msg[LAUNCH_MAX_BYTES], ack = 0;
+		struct sockaddr_un addr;
+		size_t n = EyesLaunchEncode((int)wargv.size(), wargv.data(), msg, sizeof(msg));
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", argv[1]);
+		if (fd >= 0 && n > 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+			WriteAll(fd, msg, n) && ReadAll(fd, &ack, 1) && ack) {
+			close(fd);
+			return 0;
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+
+	ColdStart(&opt);
+	return 0;
+}
+
+static double LaunchProcess(const char *self, const char *mode, const char *sockPath)
+{
+	std::vector<const char *> args = { self, "--launch-child", mode, sockPath };
+	long long start = NowNs();
+	pid_t pid;
+	int status;
+
+	args.push_back("-geometry");
+	args.push_back("1920x1080+0+0");
+	args.push_back(NULL);
+
+	pid = fork();
+	if (pid == 0) {
+		execvp(self, (char **)args.data());
+		_exit(127);
+	}
+	if (pid < 0)
+		return -1;
+	waitpid(pid, &status, 0);
+	return (double)(NowNs() - start) / 1000000;
+}
+
+//
+// Cold and forwarded launches as whole processes. Both pay for the
+// process creation, so that the difference is the startup which the
+// forwarded launch skips.
+//
+static void ReportLaunch(const char *self)
+{
+	static const char *modes[] = { "cold", "forward" };
+	const int launches = 20;
+	char sockPath[108];
+	struct sockaddr_un addr;
+	int fd;
+
+	if (g_filter && strstr("launch_process", g_filter) == NULL)
+		return;
+
+	snprintf(sockPath, sizeof(sockPath), "/tmp/wineyes_bench.%d.sock", (int)getpid());
+	unlink(sockPath);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sockPath);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+		fprintf(stderr, "%s: cannot listen\n", sockPath);
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	//
+	// The running instance.
+	//
+	std::thread server([fd, launches] {
+		for (int i = 0; i < launches; i++) {
+			struct EyesOptions opt;
+			int conn = accept(fd, NULL, NULL);
+
+			if (conn < 0)
+				break;
+			LaunchServe(conn, &opt);
+			close(conn);
+		}
+	});
+
+	for (const char *mode : modes) {
+		std::vector<double> ms;
+		double sum = 0;
+
+		for (int i = 0; i < launches; i++) {
+			double t = LaunchProcess(self, mode, sockPath);
+			if (t < 0)
+				break;
+			ms.push_back(t);
+			sum += t;
+		}
+		if (ms.empty())
+			continue;
+		std::sort(ms.begin(), ms.end());
+		printf("{\"kernel\":\"launch_process\",\"param\":\"%s\",\"launches\":%d,"
+			"\"ms_mean\":%.3f,\"ms_p50\":%.3f,\"ms_min\":%.3f}\n",
+			mode, (int)ms.size(), sum / ms.size(), ms[ms.size() / 2], ms[0]);
+		fflush(stdout);
+	}
+
+	//
+	// Wake up the server if a launch did not reach it.
+	//
+	shutdown(fd, SHUT_RDWR);
+	server.join();
+	close(fd);
+	unlink(sockPath);
+}
+#endif
+
+static void LaunchBenches(const char *self)
+{
+	struct LaunchCtx *c = new struct LaunchCtx;
+	char param[] = "-monitor 2 -geometry 300x200+2000+700 -remote";
+
+	c->bytes = EyesLaunchEncode(LAUNCH_ARGS, (wchar_t **)g_launchArgs, c->msg, sizeof(c->msg));
+	RunBench("launch_encode", param, BenchLaunchEncode, c);
+	RunBench("launch_decode", param, BenchLaunchDecode, c);
+#ifndef _WIN32
+	if ((!g_filter || strstr("launch_socket", g_filter)) &&
+		socketpair(AF_UNIX, SOCK_STREAM, 0, c->sv) == 0) {
+		RunBench("launch_socket", param, BenchLaunchSocket, c);
+		close(c->sv[0]);
+		close(c->sv[1]);
+	}
+	ReportLaunch(self);
+#endif
+	delete c;
+}
+
+int main(int argc, char **argv)
+{
+#ifndef _WIN32
+	if (argc > 3 && strcmp(argv[1], "--launch-child") == 0)
+		return LaunchChild(argc - 2, argv + 2);
+#endif
+	if (argc > 1)
+		g_filter = argv[1];
+
+	for (const struct SizeParam &sp : g_sizes)
+		RunBench("layout", sp.name, BenchLayout, (void *)&sp);
+
+	for (const struct SizeParam &sp : g_sizes) {
+		struct LookAtCtx c;
+
+		EyesComputeLayout(sp.width, sp.height, &c.layout);
+		//
+		// Cursor circling around the window.
+		//
+		for (int i = 0; i < 1024; i++) {
+			struct EyesPoint p;
+			p.x = sp.width / 2 + (i * 37) % (sp.width * 3) - sp.width;
+			p.y = sp.height / 2 + (i * 53) % (sp.height * 3) - sp.height;
+			c.path.push_back(p);
+		}
+		RunBench("lookat", sp.name, BenchLookAt, &c);
+	}
+
+	for (const struct SizeParam &sp : g_sizes) {
+		struct SpansCtx c;
+
+		EyesComputeLayout(sp.width, sp.height, &c.layout);
+		c.height = sp.height;
+		c.spans.resize((size_t)sp.height * NUM_EYES);
+		RunBench("region_spans", sp.name, BenchRegionSpans, &c);
+	}
+
+	RunBench("parse_options", "-monitor 2 -geometry 300x200+2000+700", BenchParseOptions, NULL);
+
+	for (const struct SizeParam &sp : g_sizes) {
+		struct PupilCtx c;
+
+		PupilCtxInit(&c, &sp);
+		RunBench("pupil_atlas_build", sp.name, BenchAtlasBuild, &c);
+		RunBench("pupil_direct", sp.name, BenchPupilDirect, &c);
+		RunBench("pupil_blit", sp.name, BenchPupilBlit, &c);
+	}
+
+	static const struct {
+		const char *name;
+		void (*build)(std::vector<struct SimEvent> &v);
+	} scenarios[] = {
+		{ "drag", ScenarioDrag },
+		{ "double_click", ScenarioDoubleClick },
+		{ "resize", ScenarioResize },
+		{ "default_size", ScenarioDefaultSize },
+	};
+	for (const auto &sc : scenarios) {
+		struct ReplayCtx c;
+
+		sc.build(c.events);
+		SimInit(&c.w);
+		RunBench("state_replay", sc.name, BenchReplay, &c);
+		ReportEffects(sc.name, c.events);
+	}
+
+	PaintBenches();
+	RemoteBenches(argc > 2 ? argv[2] : NULL);
+	ExportBenches();
+
+	{
+		struct FlightCtx c;
+
+		FlightCtxInit(&c);
+		RunBench("flight_ring", "push_pop", BenchFlightRing, &c);
+		RunBench("flight_encode", "hook_1000hz", BenchFlightEncode, &c);
+		RunBench("flight_decode", "hook_1000hz", BenchFlightDecode, &c);
+		c.ring->~FlightRing();
+		EyesAlignedFree(c.ring);
+		ReportFlightRatio("hook_1000hz");
+	}
+
+	CacheBenches();
+	LaunchBenches(argv[0]);
+
+	return 0;
+}
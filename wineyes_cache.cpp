@@ -0,0 +1,261 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Persistent render cache of the face.
+ */
+
+#include <string.h>
+#include "wineyes_cache.h"
+#include "wineyes_layout.h"
+#include "wineyes_tile.h"
+
+//
+// The spans and the bitmap are used in place, in the byte order of
+// the host.
+//
+static_assert(sizeof(struct EyesSpan) == 12, "EyesSpan is stored as 3 x int32");
+
+static bool LittleEndian(void)
+{
+	uint32_t v = 1;
+	uint8_t b;
+
+	memcpy(&b, &v, 1);
+	return b == 1;
+}
+
+static void Put32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static void Put64(uint8_t *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+	uint32_t v = 0;
+	for (int i = 0; i < 4; i++)
+		v |= (uint32_t)p[i] << (i * 8);
+	return v;
+}
+
+static uint64_t Get64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++)
+		v |= (uint64_t)p[i] << (i * 8);
+	return v;
+}
+
+static size_t Align(size_t v)
+{
+	return (v + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+}
+
+//
+// Checksum of 64bit words in 4 independent lanes.
+//
+#define CACHE_PRIME 0x100000001b3ULL
+
+static uint64_t Rotl(uint64_t v, int n)
+{
+	return (v << n) | (v >> (64 - n));
+}
+
+static uint64_t Hash(const uint8_t *p, size_t n, uint64_t seed)
+{
+	uint64_t lane[4] = { seed, seed + 1, seed + 2, seed + 3 };
+	uint64_t h;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		for (int k = 0; k < 4; k++) {
+			uint64_t v;
+
+			memcpy(&v, p + i + k * 8, 8);
+			lane[k] = Rotl(lane[k] ^ v, 29) * CACHE_PRIME;
+		}
+	}
+	for (; i < n; i++)
+		lane[0] = Rotl(lane[0] ^ p[i], 29) * CACHE_PRIME;
+
+	h = n;
+	for (int k = 0; k < 4; k++)
+		h = Rotl(h ^ lane[k], 31) * CACHE_PRIME;
+	return h ^ (h >> 32);
+}
+
+static bool ValidKey(const struct EyesCacheKey *key)
+{
+	return key->width > 0 && key->height > 0 && key->width <= 32767 && key->height <= 32767 &&
+		(long long)key->width * key->height >= TILE_PAINT_MIN_PIXELS;
+}
+
+static size_t SpanOffset(void)
+{
+	return CACHE_HEADER_BYTES;
+}
+
+static int Bands(const struct EyesCacheKey *key)
+{
+	return (key->height + CACHE_BAND_ROWS - 1) / CACHE_BAND_ROWS;
+}
+
+static size_t BandHashOffset(const struct EyesCacheKey *key)
+{
+	return Align(SpanOffset() + (size_t)key->height * NUM_EYES * sizeof(struct EyesSpan));
+}
+
+static size_t BitmapOffset(const struct EyesCacheKey *key)
+{
+	return Align(BandHashOffset(key) + (size_t)Bands(key) * sizeof(uint64_t));
+}
+
+//
+// Hash of the samples of a band of the bitmap, and of its last bytes,
+// so that every page of it is touched.
+//
+static uint64_t BandHash(const uint32_t *bits, const struct EyesCacheKey *key, int band)
+{
+	int top = band * CACHE_BAND_ROWS;
+	int bottom = top + CACHE_BAND_ROWS < key->height ? top + CACHE_BAND_ROWS : key->height;
+	const uint8_t *p = (const uint8_t *)(bits + (size_t)top * key->width);
+	size_t n = (size_t)(bottom - top) * key->width * sizeof(uint32_t);
+	uint64_t h = (uint64_t)band;
+
+	for (size_t i = 0; i < n; i += CACHE_SAMPLE_BYTES)
+		h = Hash(p + i, n - i < CACHE_ALIGN ? n - i : CACHE_ALIGN, h);
+	if (n >= CACHE_ALIGN)
+		h = Hash(p + n - CACHE_ALIGN, CACHE_ALIGN, h);
+	return h;
+}
+
+//
+// Checksum of the header before it, the spans and the band hashes.
+//
+static uint64_t Checksum(const uint8_t *base, const struct EyesCacheKey *key)
+{
+	uint64_t h = Hash(base, 48, 0xcbf29ce484222325ULL);
+
+	return Hash(base + SpanOffset(), BitmapOffset(key) - SpanOffset(), h);
+}
+
+size_t EyesCacheFileSize(const struct EyesCacheKey *key)
+{
+	unsigned long long size;
+
+	if (!ValidKey(key))
+		return 0;
+	size = BitmapOffset(key) + (unsigned long long)key->width * key->height * sizeof(uint32_t);
+	return size <= CACHE_MAX_BYTES ? (size_t)size : 0;
+}
+
+bool EyesCacheBuild(uint8_t *base, size_t size, const struct EyesCacheKey *key,
+	struct EyesTilePool *pool)
+{
+	struct EyesLayout layout;
+	struct EyesFrame frame;
+	size_t spanOff = SpanOffset(), hashOff = BandHashOffset(key), bitmapOff = BitmapOffset(key);
+	int nspans;
+
+	if (!LittleEndian() || size == 0 || size != EyesCacheFileSize(key))
+		return false;
+
+	//
+	// The cache is invalid until the checksum is written.
+	//
+	memset(base, 0, CACHE_HEADER_BYTES);
+
+	EyesComputeLayout(key->width, key->height, &layout);
+	nspans = EyesRegionSpans(&layout, key->height, (struct EyesSpan *)(base + spanOff));
+	memset(base + spanOff + nspans * sizeof(struct EyesSpan), 0,
+		hashOff - spanOff - nspans * sizeof(struct EyesSpan));
+	memset(base + hashOff, 0, bitmapOff - hashOff);
+
+	frame.bits = (uint32_t *)(base + bitmapOff);
+	frame.stride = key->width;
+	frame.width = key->width;
+	frame.height = key->height;
+	EyesPaintFace(pool, &frame, &layout, NULL);
+	for (int i = 0; i < Bands(key); i++)
+		Put64(base + hashOff + i * sizeof(uint64_t), BandHash(frame.bits, key, i));
+
+	Put32(base, CACHE_MAGIC);
+	Put32(base + 4, CACHE_VERSION);
+	Put32(base + 8, EYES_LAYOUT_VERSION);
+	Put32(base + 12, (uint32_t)key->width);
+	Put32(base + 16, (uint32_t)key->height);
+	Put32(base + 20, CACHE_BAND_ROWS);
+	Put32(base + 24, (uint32_t)nspans);
+	Put32(base + 28, (uint32_t)hashOff);
+	Put32(base + 32, (uint32_t)spanOff);
+	Put32(base + 36, (uint32_t)bitmapOff);
+	Put64(base + 40, size);
+	Put64(base + 48, Checksum(base, key));
+	return true;
+}
+
+bool EyesCacheOpen(const uint8_t *base, size_t size, const struct EyesCacheKey *key,
+	struct EyesCache *cache)
+{
+	struct EyesCacheKey k;
+	int nspans;
+
+	if (!LittleEndian() || base == NULL || size < CACHE_HEADER_BYTES)
+		return false;
+	if (Get32(base) != CACHE_MAGIC || Get32(base + 4) != CACHE_VERSION ||
+		Get32(base + 8) != EYES_LAYOUT_VERSION)
+		return false;
+
+	k.width = (int)Get32(base + 12);
+	k.height = (int)Get32(base + 16);
+	if (key && (k.width != key->width || k.height != key->height))
+		return false;
+
+	//
+	// The layout of the file follows from the key.
+	//
+	nspans = (int)Get32(base + 24);
+	if (Get32(base + 20) != CACHE_BAND_ROWS || Get64(base + 40) != size ||
+		size != EyesCacheFileSize(&k) || Get32(base + 28) != BandHashOffset(&k) ||
+		Get32(base + 32) != SpanOffset() || Get32(base + 36) != BitmapOffset(&k) ||
+		nspans < 0 || nspans > k.height * NUM_EYES)
+		return false;
+	if (Get64(base + 48) != Checksum(base, &k))
+		return false;
+
+	cache->key = k;
+	cache->nspans = nspans;
+	cache->spans = (const struct EyesSpan *)(base + SpanOffset());
+	cache->bits = (const uint32_t *)(base + BitmapOffset(&k));
+	cache->bandHash = base + BandHashOffset(&k);
+	memset(cache->checked, 0, sizeof(cache->checked));
+	return true;
+}
+
+bool EyesCacheCheckRows(struct EyesCache *cache, int top, int bottom)
+{
+	if (top < 0)
+		top = 0;
+	if (bottom > cache->key.height)
+		bottom = cache->key.height;
+
+	for (int i = top / CACHE_BAND_ROWS; i * CACHE_BAND_ROWS < bottom; i++) {
+		uint64_t bit = 1ULL << (i % 64);
+
+		if (cache->checked[i / 64] & bit)
+			continue;
+		if (Get64(cache->bandHash + i * sizeof(uint64_t)) != BandHash(cache->bits, &cache->key, i))
+			return false;
+		cache->checked[i / 64] |= bit;
+	}
+	return true;
+}
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Persistent render cache of the face.
+ *
+ * The region spans and the face bitmap of a client size are stored in a
+ * file, which is memory-mapped at startup. When it is valid, the window
+ * region is made of the stored spans and the first paint is a blit of
+ * the stored bitmap, without any rasterization. A cache of another
+ * format, layout version or size, or with a wrong checksum, is stale
+ * and rebuilt. This part does not depend on Win32, so that the cache
+ * can be read on Linux.
+ *
+ * Only the sizes of the tile renderer are cached, so that the stored
+ * face is the one which the tile renderer paints without the cache.
+ * The smaller faces are painted by GDI, which is as fast as opening
+ * the cache.
+ *
+ * The file is written under another name and renamed when it is
+ * complete. The checksum covers the header, the spans and a table of
+ * band hashes, and is checked when the file is opened. Each band of
+ * CACHE_BAND_ROWS rows of the bitmap has a hash of a sample of every
+ * CACHE_SAMPLE_BYTES of it, which is checked by EyesCacheCheckRows()
+ * before the band is first blitted: hashing megabytes of pixels at
+ * startup costs more than painting them. The samples catch a torn or
+ * zeroed page of the bitmap, but not a pixel changed between them.
+ *
+ * File format (little endian):
+ *   Header, CACHE_HEADER_BYTES bytes
+ *     "XERC", format version, layout version, width, height, band rows,
+ *     span count, band hash offset, span offset, bitmap offset,
+ *     file bytes (64bit),
+ *     checksum (64bit) of the header before it, the spans and the band
+ *     hashes
+ *   Spans at span offset, height x NUM_EYES at most
+ *     int32 y, x0, x1, as struct EyesSpan
+ *   Band hashes at band hash offset
+ *     uint64, one per band
+ *   Bitmap at bitmap offset
+ *     Top-down 32bit BGR, width x height pixels
+ */
+
+#ifndef _WINEYES_CACHE_H_
+#define _WINEYES_CACHE_H_
+
+#include "wineyes_core.h"
+#include "wineyes_tile.h"
+
+#define CACHE_MAGIC        0x43524558   // "XERC"
+#define CACHE_VERSION      3
+#define CACHE_HEADER_BYTES 64
+#define CACHE_ALIGN        64
+#define CACHE_BAND_ROWS    EYES_TILE_H
+#define CACHE_SAMPLE_BYTES 4096          // A page
+#define CACHE_MAX_BANDS    ((32767 + CACHE_BAND_ROWS - 1) / CACHE_BAND_ROWS)
+//
+// The faces of larger windows are not cached; the tile renderer
+// paints them in parallel anyway.
+//
+#define CACHE_MAX_BYTES    (64 * 1024 * 1024)
+
+struct EyesCacheKey {
+	int width;      // Client size
+	int height;
+};
+
+//
+// View of a valid cache. It points into the mapped file.
+//
+struct EyesCache {
+	struct EyesCacheKey key;
+	int nspans;
+	const struct EyesSpan *spans;
+	const uint32_t *bits;   // Face bitmap, the stride is key.width
+	const uint8_t *bandHash;
+	uint64_t checked[(CACHE_MAX_BANDS + 63) / 64];  // Bands found valid
+};
+
+//
+// Size of the cache file of the key, or 0 if it is not cached, which
+// includes the sizes painted by GDI.
+//
+size_t EyesCacheFileSize(const struct EyesCacheKey *key);
+
+//
+// Render the face of the key into the mapped file of EyesCacheFileSize()
+// bytes. The checksum is written last.
+//
+bool EyesCacheBuild(uint8_t *base, size_t size, const struct EyesCacheKey *key,
+	struct EyesTilePool *pool);
+
+//
+// Check the mapped file and fill the view. Returns false if it is stale
+// for the key, or broken. If 'key' is NULL any key is accepted.
+//
+bool EyesCacheOpen(const uint8_t *base, size_t size, const struct EyesCacheKey *key,
+	struct EyesCache *cache);
+
+//
+// Check the bands of the bitmap which hold the rows [top, bottom), and
+// which are not checked yet. Returns false if any of them is broken.
+//
+bool EyesCacheCheckRows(struct EyesCache *cache, int top, int bottom);
+
+#endif   /* _WINEYES_CACHE_H_ */
@@ -0,0 +1,622 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * This software is based on WinEyes 1.2.
+ * Special thanks to Robert W. Buccigrossi.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wineyes_core.h"
+#include "wineyes_layout.h"
+
+//
+// Vertical supersampling of the pupil rasterizer.
+// The horizontal coverage is computed analytically.
+//
+#define PUPIL_SUBROWS 4
+
+void EyesComputeLayout(int width, int height, struct EyesLayout *layout)
+{
+	EyesDefaultFace::Compute(width, height, layout);
+}
+
+bool EyesUpdateLayout(int width, int height, struct EyesLayout *layout)
+{
+	if (layout->size.x == width && layout->size.y == height)
+		return false;
+	EyesComputeLayout(width, height, layout);
+	return true;
+}
+
+//
+// Static tests of the layout.
+//
+template <class Face>
+struct LayoutCheck {
+	//
+	// The white of the eyes and the pupil at the maximum travel are
+	// inside of the outline.
+	//
+	static constexpr bool Inside(int w, int h, int k)
+	{
+		return Face::EyeLeft(w, k) < Face::ScleraLeft(w, k) &&
+			Face::ScleraRight(w, k) < Face::EyeRight(w, k) &&
+			Face::EyeTop(h) < Face::ScleraTop(h) &&
+			Face::ScleraBottom(h) < Face::EyeBottom(h) &&
+			Face::ScleraLeft(w, k) <= Face::CenterX(w, k) - Face::TravelX(w) - Face::PupilX(w) &&
+			Face::CenterX(w, k) + Face::TravelX(w) + Face::PupilX(w) <= Face::ScleraRight(w, k) &&
+			Face::ScleraTop(h) <= Face::CenterY(h) - Face::TravelY(h) - Face::PupilY(h) &&
+			Face::CenterY(h) + Face::TravelY(h) + Face::PupilY(h) <= Face::ScleraBottom(h);
+	}
+
+	//
+	// The eyes are ordered from left to right, do not overlap, and fit
+	// in the client area.
+	//
+	static constexpr bool Apart(int w, int k)
+	{
+		return k == 0 ? Face::EyeLeft(w, 0) >= 0 :
+			Face::EyeRight(w, k - 1) <= Face::EyeLeft(w, k) && Apart(w, k - 1);
+	}
+
+	static constexpr bool AllInside(int w, int h, int k)
+	{
+		return k < 0 || (Inside(w, h, k) && AllInside(w, h, k - 1));
+	}
+
+	static constexpr bool Valid(int w, int h)
+	{
+		return AllInside(w, h, Face::eyes - 1) && Apart(w, Face::eyes - 1) &&
+			Face::EyeRight(w, Face::eyes - 1) <= w && Face::EyeBottom(h) <= h;
+	}
+};
+
+typedef LayoutCheck<EyesDefaultFace> DefaultCheck;
+
+static_assert(DefaultCheck::Valid(DEFAULT_W, DEFAULT_H), "Default size");
+static_assert(DefaultCheck::Valid(1920, 1080), "1080p");
+static_assert(DefaultCheck::Valid(3840, 2160), "4K");
+static_assert(DefaultCheck::Valid(7680, 4320), "8K");
+static_assert(DefaultCheck::Valid(7680, 2160), "Video wall");
+static_assert(DefaultCheck::Valid(60, 40), "Small window");
+static_assert(LayoutCheck<EyesFace<3> >::Valid(300, 100), "Three eyes");
+static_assert(LayoutCheck<EyesFace<1> >::Valid(100, 100), "One eye");
+
+//
+// The default face is the one of the original WinEyes.
+//
+static_assert(EyesDefaultFace::EyeRight(DEFAULT_W, LEYE) == 71 &&
+	EyesDefaultFace::EyeLeft(DEFAULT_W, REYE) == 78 &&
+	EyesDefaultFace::ScleraLeft(DEFAULT_W, LEYE) == 8 &&
+	EyesDefaultFace::CenterX(DEFAULT_W, LEYE) == 37 &&
+	EyesDefaultFace::CenterY(DEFAULT_H) == 51 &&
+	EyesDefaultFace::TravelX(DEFAULT_W) == 16 &&
+	EyesDefaultFace::PupilX(DEFAULT_W) == 6, "Original face at the default size");
+
+void EyesLookAt(struct EyesPoint mouseloc, const struct EyesLayout *layout, struct EyesPoint pupil[NUM_EYES])
+{
+	const struct EyesPoint *center = layout->center;
+	struct EyesPoint esize = layout->eyesize;
+	struct EyesPoint relmouse;
+	double len;
+	double eyecos, eyesin;
+	double currentx, currenty;
+
+	for (int i = 0; i < NUM_EYES; i++) {
+		relmouse.x = mouseloc.x - center[i].x;
+		relmouse.y = mouseloc.y - center[i].y;
+
+		if ((relmouse.x != 0) || (relmouse.y != 0)) {
+			len = sqrt((double)relmouse.x * relmouse.x + (double)relmouse.y * relmouse.y);
+			eyecos = relmouse.x / len;
+			eyesin = relmouse.y / len;
+		}
+		else {
+			eyecos = 0; eyesin = 0;
+		}
+
+		currentx = eyecos * esize.x; currenty = eyesin * esize.y;
+		if (currentx * currentx + currenty * currenty >
+			(double)relmouse.x * relmouse.x + (double)relmouse.y * relmouse.y) {
+			currentx = relmouse.x;
+			currenty = relmouse.y;
+		}
+
+		pupil[i].x = center[i].x * SUBPIXEL_ONE + (int)(currentx * SUBPIXEL_ONE);
+		pupil[i].y = center[i].y * SUBPIXEL_ONE + (int)(currenty * SUBPIXEL_ONE);
+	}
+}
+
+static uint32_t ISqrt(uint64_t v)
+{
+	uint64_t r = 0, bit = 1ULL << 62;
+
+	while (bit > v)
+		bit >>= 2;
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		}
+		else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)r;
+}
+
+//
+// Square root from a nearby value, such as the one of the previous row.
+//
+static uint32_t ISqrtNear(uint64_t v, uint32_t g)
+{
+	while ((uint64_t)g * g > v)
+		g--;
+	while ((uint64_t)(g + 1) * (g + 1) <= v)
+		g++;
+	return g;
+}
+
+static int FloorDiv2(int v)
+{
+	return v >= 0 ? v / 2 : -((1 - v) / 2);
+}
+
+//
+// In units of half a pixel, the center of pixel x is 2x+1. The pixel
+// is inside if |X| <= m where X = 2x+1 - (left+right) and
+// m^2 * H^2 <= W^2 * (H^2 - Y^2) for the width W and the height H.
+//
+bool EyesEllipseSpan(const struct EyesRect *r, int y, int *x0, int *x1, int *hint)
+{
+	int64_t w = r->right - r->left;
+	int64_t h = r->bottom - r->top;
+	int64_t dy = 2 * y + 1 - (r->top + r->bottom);
+	int sum = r->left + r->right;
+	uint64_t q;
+	int m;
+
+	if (w <= 0 || h <= 0)
+		return false;
+	if (dy <= -h || dy >= h)
+		return false;
+
+	q = (uint64_t)(w * w) * (uint64_t)(h * h - dy * dy) / (uint64_t)(h * h);
+	if (hint) {
+		m = (int)ISqrtNear(q, (uint32_t)*hint);
+		*hint = m;
+	}
+	else {
+		m = (int)ISqrt(q);
+	}
+	*x0 = -FloorDiv2(m + 1 - sum);
+	*x1 = FloorDiv2(sum - 1 + m) + 1;
+	return *x0 < *x1;
+}
+
+static int EllipseSpans(const struct EyesRect rects[NUM_EYES], int height, struct EyesSpan *spans)
+{
+	int hint[NUM_EYES] = { 0 };
+	int n = 0;
+
+	for (int y = 0; y < height; y++) {
+		for (int i = 0; i < NUM_EYES; i++) {
+			int x0, x1;
+
+			if (!EyesEllipseSpan(&rects[i], y, &x0, &x1, &hint[i]))
+				continue;
+			//
+			// The eyes may touch each other on a very narrow window.
+			//
+			if (n > 0 && spans[n - 1].y == y && spans[n - 1].x1 >= x0) {
+				if (x1 > spans[n - 1].x1)
+					spans[n - 1].x1 = x1;
+				continue;
+			}
+			spans[n].y = y;
+			spans[n].x0 = x0;
+			spans[n].x1 = x1;
+			n++;
+		}
+	}
+	return n;
+}
+
+int EyesRegionSpans(const struct EyesLayout *layout, int height, struct EyesSpan *spans)
+{
+	return EllipseSpans(layout->outline, height, spans);
+}
+
+int EyesScleraSpans(const struct EyesLayout *layout, int height, struct EyesSpan *spans)
+{
+	return EllipseSpans(layout->sclera, height, spans);
+}
+
+//
+// Accumulate the coverage of the span [x0, x1) into the row.
+//
+static void AddSpan(float *row, int width, double x0, double x1, float weight)
+{
+	int i0, i1;
+
+	if (x0 < 0)
+		x0 = 0;
+	if (x1 > width)
+		x1 = width;
+	if (x0 >= x1)
+		return;
+
+	i0 = (int)x0;
+	i1 = (int)x1;
+	if (i0 == i1) {
+		row[i0] += (float)(x1 - x0) * weight;
+		return;
+	}
+	row[i0] += (float)(i0 + 1 - x0) * weight;
+	for (int i = i0 + 1; i < i1; i++)
+		row[i] += weight;
+	if (i1 < width)
+		row[i1] += (float)(x1 - i1) * weight;
+}
+
+void EyesRasterizePupil(uint32_t *bits, int stride, int w, int h, double cx, double cy, double rx, double ry)
+{
+	float *row = (float *)malloc(w * sizeof(float));
+
+	if (row == NULL)
+		return;
+
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++)
+			row[x] = 0;
+
+		for (int s = 0; s < PUPIL_SUBROWS; s++) {
+			double dy = (y + (s + 0.5) / PUPIL_SUBROWS - cy) / ry;
+			double hw;
+
+			if (dy <= -1.0 || dy >= 1.0)
+				continue;
+			hw = rx * sqrt(1.0 - dy * dy);
+			AddSpan(row, w, cx - hw, cx + hw, 1.0f / PUPIL_SUBROWS);
+		}
+
+		for (int x = 0; x < w; x++) {
+			float cov = row[x] > 1.0f ? 1.0f : row[x];
+			uint32_t v = (uint32_t)(255.0f * (1.0f - cov) + 0.5f);
+			bits[(size_t)y * stride + x] = (v << 16) | (v << 8) | v;
+		}
+	}
+
+	free(row);
+}
+
+void EyesQuantizePhase(int pos, int phases, int *ipos, int *phase)
+{
+	int q = (pos * phases + SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT;
+	int i = q >= 0 ? q / phases : -((-q + phases - 1) / phases);
+
+	*ipos = i;
+	*phase = q - i * phases;
+}
+
+//
+// The pointer returned by malloc() is kept just before the aligned block.
+//
+void *EyesAlignedAlloc(size_t size, size_t align)
+{
+	uint8_t *raw, *p;
+
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+	if (size > SIZE_MAX - align - sizeof(void *))
+		return NULL;
+	raw = (uint8_t *)malloc(size + align + sizeof(void *));
+	if (raw == NULL)
+		return NULL;
+	p = raw + sizeof(void *);
+	p += (align - (uintptr_t)p % align) % align;
+	memcpy(p - sizeof(void *), &raw, sizeof(void *));
+	return p;
+}
+
+void EyesAlignedFree(void *p)
+{
+	void *raw;
+
+	if (p == NULL)
+		return;
+	memcpy(&raw, (uint8_t *)p - sizeof(void *), sizeof(void *));
+	free(raw);
+}
+
+//
+// Parse a decimal integer with an optional sign as "%d" does.
+//
+static bool ParseInt(const wchar_t **p, int *val)
+{
+	const wchar_t *s = *p;
+	bool neg = false;
+	long v = 0;
+
+	while (*s == L' ' || *s == L'\t')
+		s++;
+	if (*s == L'+' || *s == L'-') {
+		neg = (*s == L'-');
+		s++;
+	}
+	if (*s < L'0' || *s > L'9')
+		return false;
+	while (*s >= L'0' && *s <= L'9') {
+		if (v < 100000000)
+			v = v * 10 + (*s - L'0');
+		s++;
+	}
+
+	*val = (int)(neg ? -v : v);
+	*p = s;
+	return true;
+}
+
+//
+// Match the argument against a format which is made of literal
+// characters and 'd' for an integer, and return the number of integers
+// which are matched as swscanf() does.
+//
+static int ScanInts(const wchar_t *arg, const char *fmt, int *vals)
+{
+	int n = 0;
+
+	for (; *fmt; fmt++) {
+		if (*fmt == 'd') {
+			if (!ParseInt(&arg, &vals[n]))
+				break;
+			n++;
+		}
+		else {
+			if (*arg != (wchar_t)*fmt)
+				break;
+			arg++;
+		}
+	}
+	return n;
+}
+
+//
+// -geometry WIDTHxHEIGHT+XOFF+YOFF
+// -geometry WIDTHxHEIGHT
+// -geometry +XOFF+YOFF
+//
+bool EyesParseGeometry(const wchar_t *arg, struct EyesOptions *opt)
+{
+	int v[4];
+
+	if (ScanInts(arg, "dxd+d+d", v) == 4) {
+		opt->geometryWidth = v[0];
+		opt->geometryHeight = v[1];
+		opt->geometryXoff = v[2];
+		opt->geometryYoff = v[3];
+		return true;
+	}
+
+	if (ScanInts(arg, "dxd", v) == 2) {
+		opt->geometryWidth = v[0];
+		opt->geometryHeight = v[1];
+		return true;
+	}
+
+	if (ScanInts(arg, "+d+d", v) == 2) {
+		opt->geometryXoff = v[0];
+		opt->geometryYoff = v[1];
+		return true;
+	}
+
+	return false;
+}
+
+//
+// -monitor screen_no
+//
+bool EyesParseMonitor(const wchar_t *arg, struct EyesOptions *opt)
+{
+	int val;
+
+	if (ScanInts(arg, "d", &val) != 1)
+		return false;
+	if (!(val >= DEFAULT_SCREEN_NO && val <= MAX_SCREEN_NO))
+		val = 1;
+	opt->monitorNumber = val;
+	return true;
+}
+
+static bool StrEqualNoCase(const wchar_t *a, const wchar_t *b)
+{
+	for (; *a && *b; a++, b++) {
+		wchar_t ca = (*a >= L'A' && *a <= L'Z') ? *a - L'A' + L'a' : *a;
+		wchar_t cb = (*b >= L'A' && *b <= L'Z') ? *b - L'A' + L'a' : *b;
+		if (ca != cb)
+			return false;
+	}
+	return *a == *b;
+}
+
+static bool StrEndsWithNoCase(const wchar_t *s, const wchar_t *suffix)
+{
+	size_t len = wcslen(s), slen = wcslen(suffix);
+
+	return len > slen && StrEqualNoCase(s + len - slen, suffix);
+}
+
+static void StrCopy(wchar_t *dst, const wchar_t *src, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < size && src[i]; i++)
+		dst[i] = src[i];
+	dst[i] = L'\0';
+}
+
+enum commandOption {
+	OPT_NONE,       // No argument.
+	OPT_GEOMETRY,   // -geometry
+	OPT_MONITOR,    // -monitor
+	OPT_EXPORT,     // -export
+	OPT_OUTPUT,     // -output
+	OPT_FORMAT,     // -format
+	OPT_FPS,        // -fps
+	OPT_THREADS,    // -threads
+	OPT_RECORD,     // -record
+	OPT_RECORD_SIZE,// -record-size
+	OPT_REMOTE_FPS, // -remote-fps
+	OPT_REMOTE_KBPS,// -remote-kbps
+	OPT_REMOTE_GRID,// -remote-grid
+};
+
+//
+// Parse the command line options.
+// argv does not include the program name.
+//
+void EyesParseOptions(int argc, wchar_t **argv, struct EyesOptions *opt)
+{
+	enum commandOption optType = OPT_NONE;
+	bool formatGiven = false;
+
+	memset(opt, 0, sizeof(*opt));
+	opt->geometryXoff = DEFAULT_X;
+	opt->geometryYoff = DEFAULT_Y;
+	opt->geometryWidth = DEFAULT_W;
+	opt->geometryHeight = DEFAULT_H;
+	opt->monitorNumber = DEFAULT_SCREEN_NO;
+	opt->exportOption.format = EXPORT_Y4M;
+	opt->exportOption.fps = DEFAULT_FPS;
+	opt->recordSize = DEFAULT_RECORD_MB;
+	opt->remoteFps = DEFAULT_REMOTE_FPS;
+	opt->remoteKbps = DEFAULT_REMOTE_KBPS;
+	opt->remoteGrid = DEFAULT_REMOTE_GRID;
+
+	for (int i = 0; i < argc; i++) {
+		if (optType != OPT_NONE) {
+			enum commandOption type = optType;
+			int val;
+
+			optType = OPT_NONE;
+
+			switch (type) {
+			case OPT_GEOMETRY:
+				EyesParseGeometry(argv[i], opt);
+				break;
+
+			case OPT_MONITOR:
+				EyesParseMonitor(argv[i], opt);
+				break;
+
+			case OPT_EXPORT:
+				StrCopy(opt->exportOption.trace, argv[i], EYES_MAX_PATH);
+				opt->exportMode = true;
+				break;
+
+			case OPT_OUTPUT:
+				StrCopy(opt->exportOption.output, argv[i], EYES_MAX_PATH);
+				break;
+
+			case OPT_FORMAT:
+				if (StrEqualNoCase(argv[i], L"y4m")) {
+					opt->exportOption.format = EXPORT_Y4M;
+					formatGiven = true;
+				}
+				else if (StrEqualNoCase(argv[i], L"bgra")) {
+					opt->exportOption.format = EXPORT_BGRA;
+					formatGiven = true;
+				}
+				break;
+
+			case OPT_FPS:
+				if (ScanInts(argv[i], "d", &val) == 1 && val >= 1 && val <= MAX_FPS)
+					opt->exportOption.fps = val;
+				break;
+
+			case OPT_THREADS:
+				if (ScanInts(argv[i], "d", &val) == 1 && val >= 1 && val <= MAX_THREADS)
+					opt->exportOption.threads = val;
+				break;
+
+			case OPT_RECORD:
+				StrCopy(opt->recordPath, argv[i], EYES_MAX_PATH);
+				break;
+
+			case OPT_RECORD_SIZE:
+				if (ScanInts(argv[i], "d", &val) == 1 && val >= 1 && val <= MAX_RECORD_MB)
+					opt->recordSize = val;
+				break;
+
+			case OPT_REMOTE_FPS:
+				if (ScanInts(argv[i], "d", &val) == 1 && val >= 1 && val <= MAX_FPS)
+					opt->remoteFps = val;
+				break;
+
+			case OPT_REMOTE_KBPS:
+				if (ScanInts(argv[i], "d", &val) == 1 && val >= 1 && val <= MAX_REMOTE_KBPS)
+					opt->remoteKbps = val;
+				break;
+
+			case OPT_REMOTE_GRID:
+				if (ScanInts(argv[i], "d", &val) == 1 && val >= 1 && val <= MAX_REMOTE_GRID)
+					opt->remoteGrid = val;
+				break;
+
+			default:
+				break;
+			}
+		}
+		else {
+			if (wcscmp(argv[i], L"-geometry") == 0) {
+				optType = OPT_GEOMETRY;
+			} else if (wcscmp(argv[i], L"-monitor") == 0) {
+				optType = OPT_MONITOR;
+			} else if (wcscmp(argv[i], L"-export") == 0) {
+				optType = OPT_EXPORT;
+			} else if (wcscmp(argv[i], L"-output") == 0) {
+				optType = OPT_OUTPUT;
+			} else if (wcscmp(argv[i], L"-format") == 0) {
+				optType = OPT_FORMAT;
+			} else if (wcscmp(argv[i], L"-fps") == 0) {
+				optType = OPT_FPS;
+			} else if (wcscmp(argv[i], L"-threads") == 0) {
+				optType = OPT_THREADS;
+			} else if (wcscmp(argv[i], L"-record") == 0) {
+				optType = OPT_RECORD;
+			} else if (wcscmp(argv[i], L"-record-size") == 0) {
+				optType = OPT_RECORD_SIZE;
+			} else if (wcscmp(argv[i], L"-remote") == 0) {
+				opt->remote = true;
+			} else if (wcscmp(argv[i], L"-noremote") == 0) {
+				opt->noRemote = true;
+			} else if (wcscmp(argv[i], L"-remote-fps") == 0) {
+				optType = OPT_REMOTE_FPS;
+			} else if (wcscmp(argv[i], L"-remote-kbps") == 0) {
+				optType = OPT_REMOTE_KBPS;
+			} else if (wcscmp(argv[i], L"-remote-grid") == 0) {
+				optType = OPT_REMOTE_GRID;
+			} else if (wcscmp(argv[i], L"-newinstance") == 0) {
+				opt->newInstance = true;
+			} else if (wcscmp(argv[i], L"-benchmark") == 0) {
+				opt->exportOption.benchmark = true;
+			}
+		}
+	}
+
+	//
+	// The output format follows the file extension unless
+	// it is given by -format.
+	//
+	if (!formatGiven) {
+		if (StrEndsWithNoCase(opt->exportOption.output, L".bgra") ||
+			StrEndsWithNoCase(opt->exportOption.output, L".raw"))
+			opt->exportOption.format = EXPORT_BGRA;
+	}
+}
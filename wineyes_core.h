@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Platform-neutral core: face layout, line of sight, region shape,
+ * pupil rasterization and command line parsing.
+ * This part does not depend on Win32 and is also built on Linux.
+ */
+
+#ifndef _WINEYES_CORE_H_
+#define _WINEYES_CORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+//
+// Eye index
+//
+#define LEYE 0
+#define REYE 1
+#define NUM_EYES 2
+
+//
+// Pupil positions are given in 1/SUBPIXEL_ONE pixel.
+//
+#define SUBPIXEL_SHIFT 8
+#define SUBPIXEL_ONE   (1 << SUBPIXEL_SHIFT)
+
+//
+// Default value for command line option
+//
+#define DEFAULT_X 0
+#define DEFAULT_Y 0
+#define DEFAULT_W 150
+#define DEFAULT_H 100
+#define DEFAULT_SCREEN_NO 1
+#define DEFAULT_FPS 30
+#define MAX_FPS 1000
+#define MAX_THREADS 64
+#define DEFAULT_RECORD_MB 4
+#define MAX_RECORD_MB 1024
+#define DEFAULT_REMOTE_FPS 10
+#define DEFAULT_REMOTE_KBPS 32
+#define MAX_REMOTE_KBPS 1048576
+#define DEFAULT_REMOTE_GRID 2
+#define MAX_REMOTE_GRID 64
+
+//
+// Maximum number of monitors to be retrieved.
+// Change this value if you want to increase the maximum value.
+//
+#define MAX_SCREEN_NO 32
+
+#define EYES_MAX_PATH 260
+
+struct EyesPoint {
+	int x;
+	int y;
+};
+
+struct EyesRect {
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+//
+// Face layout of a client area, which is computed by EyesDefaultFace
+// (wineyes_layout.h) once per resize.
+// All rectangles are in client coordinates.
+//
+struct EyesLayout {
+	struct EyesPoint size;               // Client size of the layout
+	struct EyesRect  outline[NUM_EYES];  // Black outline ellipses, which
+	                                     // also make the window region
+	struct EyesRect  sclera[NUM_EYES];   // White of the eyes
+	struct EyesPoint center[NUM_EYES];   // Center of the line of sight
+	struct EyesPoint eyesize;            // Travel of the pupil
+	struct EyesPoint eyeballsize;        // Radius of the pupil
+};
+
+void EyesComputeLayout(int width, int height, struct EyesLayout *layout);
+
+//
+// Recompute the layout only when the size is changed.
+// Returns true if it is recomputed.
+//
+bool EyesUpdateLayout(int width, int height, struct EyesLayout *layout);
+
+//
+// Line of sight.
+// The mouse position is given in client coordinates, and the centers
+// of the pupils are returned in 1/SUBPIXEL_ONE pixel.
+//
+void EyesLookAt(struct EyesPoint mouseloc, const struct EyesLayout *layout, struct EyesPoint pupil[NUM_EYES]);
+
+//
+// Region shape.
+// The eyes of the window region are returned as horizontal spans of
+// pixels [x0, x1) on row y, sorted by y and x0. At most
+// height * NUM_EYES spans are returned.
+//
+struct EyesSpan {
+	int y;
+	int x0;
+	int x1;
+};
+
+int EyesRegionSpans(const struct EyesLayout *layout, int height, struct EyesSpan *spans);
+
+//
+// The whites of the eyes as spans in the same form. The cell of a pupil
+// is a rectangle, so that it is drawn and erased only inside of them.
+//
+int EyesScleraSpans(const struct EyesLayout *layout, int height, struct EyesSpan *spans);
+
+//
+// Horizontal span [x0, x1) of the pixels of row y whose centers are
+// inside of the ellipse inscribed in the rectangle. It is computed in
+// integer arithmetic. If the rows are walked in order, 'hint' keeps the
+// half width of the previous row to speed up the square root. It is 0
+// at first, or NULL.
+//
+bool EyesEllipseSpan(const struct EyesRect *r, int y, int *x0, int *x1, int *hint);
+
+//
+// Pupil rasterization.
+// Rasterize a black anti-aliased ellipse on white into a w x h cell of
+// a top-down 32bit BGR bitmap.
+//
+void EyesRasterizePupil(uint32_t *bits, int stride, int w, int h, double cx, double cy, double rx, double ry);
+
+//
+// Round a position in 1/SUBPIXEL_ONE pixel to the nearest of 'phases'
+// sub-pixel phases.
+//
+void EyesQuantizePhase(int pos, int phases, int *ipos, int *phase);
+
+//
+// Memory aligned to 'align' bytes, a power of 2, for the structures with
+// alignas() members, which new does not align before C++17.
+// Returns NULL when out of memory.
+//
+void *EyesAlignedAlloc(size_t size, size_t align);
+void EyesAlignedFree(void *p);
+
+//
+// Command line option.
+//
+enum exportFormat {
+	EXPORT_Y4M,     // YUV4MPEG2 4:4:4 stream
+	EXPORT_BGRA,    // Raw 32bit BGRA frames, top-down
+};
+
+struct ExportOption {
+	wchar_t trace[EYES_MAX_PATH];    // Cursor trace file
+	wchar_t output[EYES_MAX_PATH];   // Output file, or stdout if empty or "-"
+	enum exportFormat format;
+	int width;
+	int height;
+	int xoff;
+	int yoff;
+	int fps;
+	int threads;              // 0 means the number of processors
+	bool benchmark;           // Report frames/second from 1 to N threads
+};
+
+struct EyesOptions {
+	int geometryXoff;
+	int geometryYoff;
+	int geometryWidth;
+	int geometryHeight;
+	int monitorNumber;
+	bool exportMode;
+	struct ExportOption exportOption;
+	wchar_t recordPath[EYES_MAX_PATH];   // Flight recording, or none if empty
+	int recordSize;                      // Size cap of the recording in MB
+	bool remote;                         // Bandwidth budgeted updates
+	bool noRemote;                       // Not enabled on remote sessions
+	int remoteFps;                       // Maximum updates/second
+	int remoteKbps;                      // Budget in KB/second
+	int remoteGrid;                      // Pupil grid in pixels
+	bool newInstance;                    // Not forwarded to the running one
+};
+
+bool EyesParseGeometry(const wchar_t *arg, struct EyesOptions *opt);
+bool EyesParseMonitor(const wchar_t *arg, struct EyesOptions *opt);
+void EyesParseOptions(int argc, wchar_t **argv, struct EyesOptions *opt);
+
+#endif   /* _WINEYES_CORE_H_ */
@@ -0,0 +1,533 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Headless frame export.
+ *
+ * The eyes are rendered following a recorded cursor trace, and the frames
+ * are written to a YUV4MPEG2 or raw BGRA stream. Every frame only depends
+ * on the cursor sample at its time, so the frames are rendered in parallel
+ * by worker threads. A bounded reorder buffer keeps the output in frame
+ * order and the memory usage flat.
+ */
+
+#include <windows.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "wineyes.h"
+
+//
+// Cursor trace.
+//
+// One sample per line in screen coordinates:
+//   TIME_MS X Y
+// Empty lines and lines beginning with '#' are ignored.
+// The samples must be sorted by time.
+//
+struct TraceSample
+{
+	long long t;
+	int x;
+	int y;
+};
+
+//
+// Number of reorder buffer slots per worker thread.
+//
+#define SLOTS_PER_THREAD 2
+
+//
+// Memory of the surfaces of the workers and the reorder buffer.
+// The threads are reduced for large frames to keep within it.
+//
+#define EXPORT_MEMORY_BYTES (1024ULL * 1024 * 1024)
+
+//
+// About 46 hours at 60 frames/second.
+//
+#define EXPORT_MAX_FRAMES 10000000
+
+struct ExportJob
+{
+	const struct ExportOption *opt;
+	const struct TraceSample *samples;
+	int nsamples;
+	int nframes;
+	size_t frameBytes;
+
+	//
+	// Reorder buffer.
+	// Frame i is rendered into slot (i % slots). A worker may only
+	// take frame i when i < written + slots, so at most 'slots' frames
+	// are held in memory.
+	//
+	int slots;
+	unsigned char *buffer;
+	bool *ready;
+	int next;
+	int written;
+	bool failed;
+
+	SRWLOCK lock;
+	CONDITION_VARIABLE cond;
+};
+
+//
+// Messages of the export.
+//
+// xeyes.exe is a GUI program, which has no stderr unless it is
+// redirected. Then the messages go to the console of the parent
+// process, or nowhere if there is none. Only an error which cannot be
+// shown there is shown by a message box.
+//
+static HANDLE g_hLog = INVALID_HANDLE_VALUE;
+
+static void ExportLogOpen(void)
+{
+	HANDLE h = GetStdHandle(STD_ERROR_HANDLE);
+
+	if (h != NULL && h != INVALID_HANDLE_VALUE) {
+		g_hLog = h;
+		return;
+	}
+	if (AttachConsole(ATTACH_PARENT_PROCESS))
+		g_hLog = CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void ExportVLog(bool error, const char *fmt, va_list ap)
+{
+	char buf[256];
+	DWORD n;
+
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	if (g_hLog != INVALID_HANDLE_VALUE && WriteFile(g_hLog, buf, lstrlen(buf), &n, NULL))
+		return;
+	if (error)
+		MessageBox(NULL, buf, WINEYES_TITLE, MB_OK);
+}
+
+static void ExportLog(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	ExportVLog(false, fmt, ap);
+	va_end(ap);
+}
+
+static void ExportError(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	ExportVLog(true, fmt, ap);
+	va_end(ap);
+}
+
+static bool ReadTrace(const WCHAR *path, struct TraceSample **samples, int *count)
+{
+	FILE *fp;
+	char line[256];
+	struct TraceSample *buf = NULL, *p;
+	int n = 0, cap = 0;
+
+	if (_wfopen_s(&fp, path, L"r") != 0)
+		return false;
+
+	while (fgets(line, sizeof(line), fp)) {
+		long long t;
+		int x, y;
+
+		if (line[0] == '#')
+			continue;
+		if (sscanf_s(line, "%lld %d %d", &t, &x, &y) != 3)
+			continue;
+		if (n > 0 && t < buf[n - 1].t)
+			continue;
+
+		if (n == cap) {
+			cap = cap ? cap * 2 : 1024;
+			p = (struct TraceSample *)realloc(buf, cap * sizeof(*buf));
+			if (p == NULL) {
+				free(buf);
+				fclose(fp);
+				return false;
+			}
+			buf = p;
+		}
+		buf[n].t = t;
+		buf[n].x = x;
+		buf[n].y = y;
+		n++;
+	}
+	fclose(fp);
+
+	*samples = buf;
+	*count = n;
+	return n > 0;
+}
+
+//
+// Find the latest sample at or before time t.
+//
+static const struct TraceSample *FindSample(const struct ExportJob *job, long long t)
+{
+	int lo = 0, hi = job->nsamples - 1;
+
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (job->samples[mid].t <= t)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return &job->samples[lo];
+}
+
+//
+// Convert a BGRA frame into the output format.
+// GDI does not write the alpha channel, so it is made opaque here.
+//
+static void ConvertFrame(const struct ExportJob *job, const DWORD *bits, unsigned char *out)
+{
+	int npixels = job->opt->width * job->opt->height;
+
+	if (job->opt->format == EXPORT_BGRA) {
+		DWORD *dst = (DWORD *)out;
+		for (int i = 0; i < npixels; i++)
+			dst[i] = bits[i] | 0xff000000;
+		return;
+	}
+
+	//
+	// ITU-R BT.601 limited range, 4:4:4 planar.
+	//
+	static const char frameHeader[] = "FRAME\n";
+	unsigned char *y, *u, *v;
+
+	memcpy(out, frameHeader, sizeof(frameHeader) - 1);
+	y = out + sizeof(frameHeader) - 1;
+	u = y + npixels;
+	v = u + npixels;
+	for (int i = 0; i < npixels; i++) {
+		int b = bits[i] & 0xff;
+		int g = (bits[i] >> 8) & 0xff;
+		int r = (bits[i] >> 16) & 0xff;
+		y[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		u[i] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		v[i] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+}
+
+static DWORD WINAPI ExportWorker(LPVOID param)
+{
+	struct ExportJob *job = (struct ExportJob *)param;
+	const struct ExportOption *opt = job->opt;
+	BITMAPINFO bmi;
+	HDC hDc;
+	HBITMAP hBitmap, hOld;
+	DWORD *bits = NULL;
+	RECT rect = { 0, 0, opt->width, opt->height };
+	struct EyesLayout layout;
+	struct PupilAtlas atlas;
+	HRGN sclera;
+
+	ZeroMemory(&bmi, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = opt->width;
+	bmi.bmiHeader.biHeight = -opt->height;  // top-down
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	hDc = CreateCompatibleDC(NULL);
+	hBitmap = CreateDIBSection(hDc, &bmi, DIB_RGB_COLORS, (void **)&bits, NULL, 0);
+	if (hDc == NULL || hBitmap == NULL) {
+		AcquireSRWLockExclusive(&job->lock);
+		job->failed = true;
+		ReleaseSRWLockExclusive(&job->lock);
+		WakeAllConditionVariable(&job->cond);
+		if (hDc)
+			DeleteDC(hDc);
+		return 1;
+	}
+	hOld = (HBITMAP)SelectObject(hDc, hBitmap);
+	ZeroMemory(&atlas, sizeof(atlas));
+	EyesComputeLayout(opt->width, opt->height, &layout);
+	sclera = WinEyesScleraRgn(&layout);
+
+	for (;;) {
+		int frame;
+		long long t;
+		const struct TraceSample *sample;
+		struct EyesPoint mouseloc, pupil[NUM_EYES];
+		RECT ball[NUM_EYES];
+
+		AcquireSRWLockExclusive(&job->lock);
+		while (!job->failed && job->next < job->nframes && job->next >= job->written + job->slots)
+			SleepConditionVariableSRW(&job->cond, &job->lock, INFINITE, 0);
+		if (job->failed || job->next >= job->nframes) {
+			ReleaseSRWLockExclusive(&job->lock);
+			break;
+		}
+		frame = job->next++;
+		ReleaseSRWLockExclusive(&job->lock);
+
+		//
+		// The same drawing as WinEyesPaint() and WinEyesUpdate().
+		// The area outside of the eyes is white as it is in the
+		// legacy menu mode.
+		//
+		t = job->samples[0].t + (long long)frame * 1000 / opt->fps;
+		sample = FindSample(job, t);
+		mouseloc.x = sample->x - opt->xoff;
+		mouseloc.y = sample->y - opt->yoff;
+
+		FillRect(hDc, &rect, (HBRUSH)GetStockObject(WHITE_BRUSH));
+		WinEyesDrawFace(hDc, &layout);
+		EyesLookAt(mouseloc, &layout, pupil);
+		PupilAtlasPrepare(&atlas, hDc, layout.eyeballsize);
+		SelectClipRgn(hDc, sclera);
+		PupilAtlasDraw(&atlas, hDc, pupil[LEYE], &ball[LEYE]);
+		PupilAtlasDraw(&atlas, hDc, pupil[REYE], &ball[REYE]);
+		SelectClipRgn(hDc, NULL);
+		GdiFlush();
+
+		ConvertFrame(job, bits, job->buffer + (size_t)(frame % job->slots) * job->frameBytes);
+
+		AcquireSRWLockExclusive(&job->lock);
+		job->ready[frame % job->slots] = true;
+		ReleaseSRWLockExclusive(&job->lock);
+		WakeAllConditionVariable(&job->cond);
+	}
+
+	PupilAtlasFree(&atlas);
+	if (sclera)
+		DeleteObject(sclera);
+	SelectObject(hDc, hOld);
+	DeleteObject(hBitmap);
+	DeleteDC(hDc);
+
+	return 0;
+}
+
+//
+// Render all frames with the given number of threads.
+// The frames are written to hOut in order, or discarded if hOut is NULL.
+//
+static bool RunExport(struct ExportJob *job, int threads, HANDLE hOut, double *seconds)
+{
+	HANDLE hThreads[MAXIMUM_WAIT_OBJECTS];
+	LARGE_INTEGER freq, start, end;
+	bool ok = true;
+	int started = 0;
+
+	job->slots = threads * SLOTS_PER_THREAD;
+	job->buffer = (unsigned char *)malloc(job->frameBytes * job->slots);
+	job->ready = (bool *)calloc(job->slots, sizeof(bool));
+	job->next = 0;
+	job->written = 0;
+	job->failed = false;
+	InitializeSRWLock(&job->lock);
+	InitializeConditionVariable(&job->cond);
+	if (job->buffer == NULL || job->ready == NULL) {
+		free(job->buffer);
+		free(job->ready);
+		return false;
+	}
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&start);
+
+	for (int i = 0; i < threads; i++) {
+		hThreads[i] = CreateThread(NULL, 0, ExportWorker, job, 0, NULL);
+		if (hThreads[i] == NULL)
+			break;
+		started++;
+	}
+	if (started == 0)
+		job->failed = true;
+
+	//
+	// Write out the frames in order.
+	//
+	for (int frame = 0; frame < job->nframes; frame++) {
+		int slot = frame % job->slots;
+		DWORD n;
+
+		AcquireSRWLockExclusive(&job->lock);
+		while (!job->failed && !job->ready[slot])
+			SleepConditionVariableSRW(&job->cond, &job->lock, INFINITE, 0);
+		ReleaseSRWLockExclusive(&job->lock);
+		if (job->failed) {
+			ok = false;
+			break;
+		}
+
+		if (hOut != NULL &&
+			(!WriteFile(hOut, job->buffer + (size_t)slot * job->frameBytes, (DWORD)job->frameBytes, &n, NULL) ||
+			n != (DWORD)job->frameBytes)) {
+			AcquireSRWLockExclusive(&job->lock);
+			job->failed = true;
+			ReleaseSRWLockExclusive(&job->lock);
+			WakeAllConditionVariable(&job->cond);
+			ok = false;
+			break;
+		}
+
+		AcquireSRWLockExclusive(&job->lock);
+		job->ready[slot] = false;
+		job->written++;
+		ReleaseSRWLockExclusive(&job->lock);
+		WakeAllConditionVariable(&job->cond);
+	}
+
+	if (started > 0)
+		WaitForMultipleObjects(started, hThreads, TRUE, INFINITE);
+	for (int i = 0; i < started; i++)
+		CloseHandle(hThreads[i]);
+
+	QueryPerformanceCounter(&end);
+	*seconds = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+	free(job->buffer);
+	free(job->ready);
+	return ok;
+}
+
+int WinEyesExport(const struct ExportOption *opt)
+{
+	struct ExportJob job;
+	struct TraceSample *samples = NULL;
+	int nsamples = 0;
+	int threads, maxThreads;
+	unsigned long long span, threadBytes;
+	double seconds;
+	HANDLE hOut;
+	bool toStdout;
+	SYSTEM_INFO si;
+
+	ExportLogOpen();
+
+	if (opt->width <= 0 || opt->height <= 0) {
+		ExportError("Invalid geometry %dx%d\n", opt->width, opt->height);
+		return 1;
+	}
+	if (!ReadTrace(opt->trace, &samples, &nsamples)) {
+		ExportError("Could not read the cursor trace %ws\n", opt->trace);
+		return 1;
+	}
+
+	//
+	// The samples are sorted, so the span is not negative. It is
+	// checked before the multiplication by the frame rate.
+	//
+	span = (unsigned long long)samples[nsamples - 1].t - (unsigned long long)samples[0].t;
+	if (span / 1000 >= EXPORT_MAX_FRAMES || span * opt->fps / 1000 >= EXPORT_MAX_FRAMES) {
+		ExportError("The cursor trace of %llu ms is too long for %d frames/second\n", span, opt->fps);
+		free(samples);
+		return 1;
+	}
+
+	ZeroMemory(&job, sizeof(job));
+	job.opt = opt;
+	job.samples = samples;
+	job.nsamples = nsamples;
+	job.nframes = (int)(span * opt->fps / 1000) + 1;
+	job.frameBytes = (size_t)opt->width * opt->height * 4;
+	if (opt->format == EXPORT_Y4M)
+		job.frameBytes = (size_t)opt->width * opt->height * 3 + 6;  // "FRAME\n"
+	if ((unsigned long long)job.frameBytes > MAXDWORD) {
+		ExportError("The frame of %dx%d is too large\n", opt->width, opt->height);
+		free(samples);
+		return 1;
+	}
+
+	threads = opt->threads;
+	if (threads <= 0) {
+		GetSystemInfo(&si);
+		threads = (int)si.dwNumberOfProcessors;
+	}
+	if (threads > MAXIMUM_WAIT_OBJECTS)
+		threads = MAXIMUM_WAIT_OBJECTS;
+	if (threads < 1)
+		threads = 1;
+
+	//
+	// Each worker holds its surface and SLOTS_PER_THREAD frames of the
+	// reorder buffer.
+	//
+	threadBytes = (unsigned long long)opt->width * opt->height * 4 + SLOTS_PER_THREAD * job.frameBytes;
+	maxThreads = (int)(EXPORT_MEMORY_BYTES / threadBytes < MAXIMUM_WAIT_OBJECTS ?
+		EXPORT_MEMORY_BYTES / threadBytes : MAXIMUM_WAIT_OBJECTS);
+	if (maxThreads < 1)
+		maxThreads = 1;
+	if (threads > maxThreads) {
+		ExportLog("threads=%d is reduced to %d for the frame size\n", threads, maxThreads);
+		threads = maxThreads;
+	}
+
+	//
+	// Benchmark: render the trace with 1 to N threads
+	// and discard the frames.
+	//
+	if (opt->benchmark) {
+		for (int i = 1; i <= threads; i++) {
+			if (!RunExport(&job, i, NULL, &seconds)) {
+				ExportError("Export failed\n");
+				free(samples);
+				return 1;
+			}
+			ExportLog("threads=%d frames=%d seconds=%.3f fps=%.1f\n",
+				i, job.nframes, seconds, job.nframes / seconds);
+		}
+		free(samples);
+		return 0;
+	}
+
+	toStdout = (opt->output[0] == L'\0' || lstrcmpW(opt->output, L"-") == 0);
+	if (toStdout)
+		hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	else
+		hOut = CreateFileW(opt->output, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hOut == NULL || hOut == INVALID_HANDLE_VALUE) {
+		ExportError("Could not open the output %ws\n", toStdout ? L"stdout" : opt->output);
+		free(samples);
+		return 1;
+	}
+
+	if (opt->format == EXPORT_Y4M) {
+		char header[128];
+		DWORD n;
+		int len = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+			opt->width, opt->height, opt->fps);
+
+		if (!WriteFile(hOut, header, len, &n, NULL) || n != (DWORD)len) {
+			ExportError("Could not write the output %ws\n", toStdout ? L"stdout" : opt->output);
+			if (!toStdout)
+				CloseHandle(hOut);
+			free(samples);
+			return 1;
+		}
+	}
+
+	if (!RunExport(&job, threads, hOut, &seconds)) {
+		ExportError("Export failed\n");
+		if (!toStdout)
+			CloseHandle(hOut);
+		free(samples);
+		return 1;
+	}
+	if (!toStdout)
+		CloseHandle(hOut);
+
+	ExportLog("threads=%d frames=%d seconds=%.3f fps=%.1f\n",
+		threads, job.nframes, seconds, job.nframes / seconds);
+
+	free(samples);
+	return 0;
+}
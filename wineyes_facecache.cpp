@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Persistent render cache of the face.
+ *
+ * The cache of the client size is mapped read only when the window is
+ * opened, if the size is painted by the tile renderer. A missing or
+ * stale cache, or one whose bitmap is found broken when it is blitted,
+ * is rebuilt by a background thread into a temporary file, which then
+ * replaces the old one, so that the next start finds it.
+ */
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "wineyes.h"
+
+#define FACE_CACHE_DIR L"XeyesForWindows"
+
+struct FaceCacheJob {
+	struct EyesCacheKey key;
+	WCHAR path[EYES_MAX_PATH];
+};
+
+//
+// Background builder, or NULL.
+//
+static HANDLE g_hBuilder;
+
+//
+// %LOCALAPPDATA%\XeyesForWindows\face-WIDTHxHEIGHT.xerc
+//
+static bool FaceCachePath(const struct EyesCacheKey *key, WCHAR *path, size_t n)
+{
+	WCHAR dir[EYES_MAX_PATH];
+	DWORD len;
+	int ret;
+
+	len = GetEnvironmentVariableW(L"LOCALAPPDATA", dir, EYES_MAX_PATH);
+	if (len == 0 || len >= EYES_MAX_PATH)
+		return false;
+
+	ret = swprintf(path, n, L"%ls\\" FACE_CACHE_DIR, dir);
+	if (ret < 0)
+		return false;
+	CreateDirectoryW(path, NULL);
+
+	ret = swprintf(path, n, L"%ls\\" FACE_CACHE_DIR L"\\face-%dx%d.xerc",
+		dir, key->width, key->height);
+	return ret > 0;
+}
+
+static DWORD WINAPI FaceCacheBuilder(LPVOID param)
+{
+	struct FaceCacheJob *job = (struct FaceCacheJob *)param;
+	size_t size = EyesCacheFileSize(&job->key);
+	WCHAR tmp[EYES_MAX_PATH + 16];
+	HANDLE hFile, hMapping;
+	uint8_t *view = NULL;
+	bool ok = false;
+
+	if (swprintf(tmp, EYES_MAX_PATH + 16, L"%ls.%lu", job->path, GetCurrentProcessId()) < 0) {
+		free(job);
+		return 0;
+	}
+
+	hFile = CreateFileW(tmp, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		free(job);
+		return 0;
+	}
+
+	hMapping = CreateFileMappingW(hFile, NULL, PAGE_READWRITE,
+		(DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+	if (hMapping)
+		view = (uint8_t *)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, size);
+	if (view) {
+		//
+		// The window thread keeps the shared pool.
+		//
+		struct EyesTilePool *pool = EyesTilePoolCreate(1);
+
+		ok = EyesCacheBuild(view, size, &job->key, pool);
+		EyesTilePoolFree(pool);
+		FlushViewOfFile(view, 0);
+		UnmapViewOfFile(view);
+	}
+	if (hMapping)
+		CloseHandle(hMapping);
+	CloseHandle(hFile);
+
+	if (!ok || !MoveFileExW(tmp, job->path, MOVEFILE_REPLACE_EXISTING))
+		DeleteFileW(tmp);
+
+	free(job);
+	return 0;
+}
+
+//
+// Rebuild the cache in the background, unless a build is running.
+//
+static void FaceCacheRebuild(const struct EyesCacheKey *key, const WCHAR *path)
+{
+	struct FaceCacheJob *job;
+
+	if (g_hBuilder) {
+		if (WaitForSingleObject(g_hBuilder, 0) == WAIT_TIMEOUT)
+			return;
+		CloseHandle(g_hBuilder);
+		g_hBuilder = NULL;
+	}
+
+	job = (struct FaceCacheJob *)malloc(sizeof(*job));
+	if (job == NULL)
+		return;
+	job->key = *key;
+	wcscpy_s(job->path, ARRAYSIZE(job->path), path);
+
+	g_hBuilder = CreateThread(NULL, 0, FaceCacheBuilder, job, 0, NULL);
+	if (g_hBuilder == NULL)
+		free(job);
+}
+
+bool FaceCacheOpen(struct FaceCache *fc, const struct EyesCacheKey *key)
+{
+	WCHAR path[EYES_MAX_PATH];
+	LARGE_INTEGER fileSize;
+	size_t size = EyesCacheFileSize(key);
+
+	ZeroMemory(fc, sizeof(*fc));
+	fc->hFile = INVALID_HANDLE_VALUE;
+	if (size == 0 || !FaceCachePath(key, path, EYES_MAX_PATH))
+		return false;
+
+	fc->hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fc->hFile != INVALID_HANDLE_VALUE && GetFileSizeEx(fc->hFile, &fileSize) &&
+		(unsigned long long)fileSize.QuadPart == size) {
+		fc->hMapping = CreateFileMappingW(fc->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (fc->hMapping)
+			fc->view = (const uint8_t *)MapViewOfFile(fc->hMapping, FILE_MAP_READ, 0, 0, size);
+		if (fc->view && EyesCacheOpen(fc->view, size, key, &fc->cache)) {
+			fc->valid = true;
+			return true;
+		}
+	}
+
+	FaceCacheClose(fc);
+	FaceCacheRebuild(key, path);
+	return false;
+}
+
+void FaceCacheClose(struct FaceCache *fc)
+{
+	if (fc->view)
+		UnmapViewOfFile(fc->view);
+	if (fc->hMapping)
+		CloseHandle(fc->hMapping);
+	if (fc->hFile != INVALID_HANDLE_VALUE && fc->hFile != NULL)
+		CloseHandle(fc->hFile);
+	ZeroMemory(fc, sizeof(*fc));
+	fc->hFile = INVALID_HANDLE_VALUE;
+}
+
+void FaceCacheReject(struct FaceCache *fc)
+{
+	struct EyesCacheKey key = fc->cache.key;
+	WCHAR path[EYES_MAX_PATH];
+
+	FaceCacheClose(fc);
+	if (FaceCachePath(&key, path, EYES_MAX_PATH))
+		FaceCacheRebuild(&key, path);
+}
+
+void FaceCacheWait(void)
+{
+	if (g_hBuilder == NULL)
+		return;
+	WaitForSingleObject(g_hBuilder, INFINITE);
+	CloseHandle(g_hBuilder);
+	g_hBuilder = NULL;
+}
@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Cursor flight recorder: ring, encoder and decoder.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "wineyes_flight.h"
+
+static const uint8_t g_fileMagic[4] = { 'X', 'E', 'F', 'R' };
+static const uint8_t g_segmentMagic[4] = { 'X', 'E', 'S', 'G' };
+
+void FlightRingInit(struct FlightRing *ring)
+{
+	ring->head.store(0);
+	ring->tail.store(0);
+	ring->dropped.store(0);
+}
+
+int FlightRingPop(struct FlightRing *ring, struct FlightEvent *out, int max)
+{
+	uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+	uint32_t head = ring->head.load(std::memory_order_acquire);
+	int n = 0;
+
+	while (tail != head && n < max) {
+		out[n++] = ring->ev[tail & (FLIGHT_RING_SIZE - 1)];
+		tail++;
+	}
+	ring->tail.store(tail, std::memory_order_release);
+	return n;
+}
+
+static void Put32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static void Put64(uint8_t *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+	uint32_t v = 0;
+	for (int i = 0; i < 4; i++)
+		v |= (uint32_t)p[i] << (i * 8);
+	return v;
+}
+
+static uint64_t Get64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++)
+		v |= (uint64_t)p[i] << (i * 8);
+	return v;
+}
+
+static uint8_t *PutVarint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static const uint8_t *GetVarint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+	uint64_t r = 0;
+
+	for (int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		r |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*v = r;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static uint64_t ZigZag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t UnZigZag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+size_t FlightFileSize(size_t bytes)
+{
+	size_t count = bytes / FLIGHT_SEGMENT_SIZE;
+
+	if (count < FLIGHT_MIN_SEGMENTS)
+		count = FLIGHT_MIN_SEGMENTS;
+	return FLIGHT_FILE_HEADER + count * FLIGHT_SEGMENT_SIZE;
+}
+
+static uint8_t *SegmentBase(const struct FlightWriter *w, uint32_t segment)
+{
+	return w->base + FLIGHT_FILE_HEADER + (size_t)segment * FLIGHT_SEGMENT_SIZE;
+}
+
+//
+// Start writing the segment. The base values of the deltas are those
+// of the last event of the previous segment.
+//
+static void BeginSegment(struct FlightWriter *w)
+{
+	uint8_t *seg = SegmentBase(w, w->segment);
+
+	//
+	// Invalidate the overwritten segment first.
+	//
+	Put64(seg + 8, 0);
+	Put32(seg + 4, 0);
+
+	memcpy(seg, g_segmentMagic, 4);
+	Put64(seg + 16, w->prev.time);
+	Put32(seg + 24, (uint32_t)w->prev.x);
+	Put32(seg + 28, (uint32_t)w->prev.y);
+	Put32(seg + 32, w->prev.hookTime);
+	Put32(seg + 36, 0);
+	Put64(seg + 8, w->sequence);
+	w->pos = FLIGHT_SEGMENT_HEADER;
+}
+
+bool FlightWriterInit(struct FlightWriter *w, uint8_t *base, size_t size, uint64_t tickFrequency)
+{
+	if (size < FlightFileSize(0))
+		return false;
+
+	memset(w, 0, sizeof(*w));
+	w->base = base;
+	w->size = size;
+	w->segmentCount = (uint32_t)((size - FLIGHT_FILE_HEADER) / FLIGHT_SEGMENT_SIZE);
+
+	memset(base, 0, FLIGHT_FILE_HEADER);
+	memcpy(base, g_fileMagic, 4);
+	Put32(base + 4, FLIGHT_VERSION);
+	Put32(base + 8, FLIGHT_SEGMENT_SIZE);
+	Put32(base + 12, w->segmentCount);
+	Put64(base + 16, tickFrequency);
+
+	for (uint32_t i = 0; i < w->segmentCount; i++)
+		memset(SegmentBase(w, i), 0, FLIGHT_SEGMENT_HEADER);
+
+	w->segment = 0;
+	w->sequence = 1;
+	BeginSegment(w);
+	return true;
+}
+
+void FlightWriterAppend(struct FlightWriter *w, const struct FlightEvent *ev, int n)
+{
+	uint8_t *seg = SegmentBase(w, w->segment);
+
+	for (int i = 0; i < n; i++) {
+		uint8_t *p;
+
+		if (w->pos + FLIGHT_MAX_RECORD > FLIGHT_SEGMENT_SIZE) {
+			Put32(seg + 4, (uint32_t)(w->pos - FLIGHT_SEGMENT_HEADER));
+			w->segment = (w->segment + 1) % w->segmentCount;
+			w->sequence++;
+			BeginSegment(w);
+			seg = SegmentBase(w, w->segment);
+		}
+
+		p = seg + w->pos;
+		*p++ = (uint8_t)ev[i].type;
+		p = PutVarint(p, ev[i].time - w->prev.time);
+		if (ev[i].type == FR_CURSOR) {
+			p = PutVarint(p, ZigZag((int64_t)ev[i].x - w->prev.x));
+			p = PutVarint(p, ZigZag((int64_t)ev[i].y - w->prev.y));
+			p = PutVarint(p, ZigZag((int64_t)(int32_t)(ev[i].hookTime - w->prev.hookTime)));
+			w->prev.x = ev[i].x;
+			w->prev.y = ev[i].y;
+			w->prev.hookTime = ev[i].hookTime;
+		}
+		w->prev.time = ev[i].time;
+		w->pos = p - seg;
+	}
+
+	//
+	// Commit the records.
+	//
+	Put32(seg + 4, (uint32_t)(w->pos - FLIGHT_SEGMENT_HEADER));
+}
+
+void FlightWriterSetDropped(struct FlightWriter *w, uint32_t dropped)
+{
+	Put32(w->base + 24, dropped);
+}
+
+struct SegmentRef {
+	uint64_t sequence;
+	const uint8_t *base;
+};
+
+long long FlightDecode(const uint8_t *base, size_t size, struct FlightInfo *info,
+	FlightDecodeFunc func, void *ctx)
+{
+	std::vector<struct SegmentRef> segs;
+	uint32_t segmentSize, segmentCount;
+	long long count = 0;
+
+	if (size < FLIGHT_FILE_HEADER || memcmp(base, g_fileMagic, 4) != 0)
+		return -1;
+	if (Get32(base + 4) != FLIGHT_VERSION)
+		return -1;
+	segmentSize = Get32(base + 8);
+	segmentCount = Get32(base + 12);
+	if (segmentSize <= FLIGHT_SEGMENT_HEADER ||
+		(size - FLIGHT_FILE_HEADER) / segmentSize < segmentCount)
+		return -1;
+	if (info) {
+		info->tickFrequency = Get64(base + 16);
+		info->segmentCount = segmentCount;
+		info->dropped = Get32(base + 24);
+	}
+
+	for (uint32_t i = 0; i < segmentCount; i++) {
+		struct SegmentRef ref;
+
+		ref.base = base + FLIGHT_FILE_HEADER + (size_t)i * segmentSize;
+		ref.sequence = Get64(ref.base + 8);
+		if (ref.sequence != 0 && memcmp(ref.base, g_segmentMagic, 4) == 0)
+			segs.push_back(ref);
+	}
+	std::sort(segs.begin(), segs.end(),
+		[](const struct SegmentRef &a, const struct SegmentRef &b) { return a.sequence < b.sequence; });
+
+	for (const struct SegmentRef &ref : segs) {
+		struct FlightEvent ev;
+		uint32_t used = Get32(ref.base + 4);
+		const uint8_t *p = ref.base + FLIGHT_SEGMENT_HEADER;
+		const uint8_t *end;
+
+		if (used > segmentSize - FLIGHT_SEGMENT_HEADER)
+			continue;
+		end = p + used;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.time = Get64(ref.base + 16);
+		ev.x = (int32_t)Get32(ref.base + 24);
+		ev.y = (int32_t)Get32(ref.base + 28);
+		ev.hookTime = Get32(ref.base + 32);
+
+		while (p < end) {
+			uint64_t v;
+
+			ev.type = *p++;
+			if ((p = GetVarint(p, end, &v)) == NULL)
+				break;
+			ev.time += v;
+			if (ev.type == FR_CURSOR) {
+				if ((p = GetVarint(p, end, &v)) == NULL)
+					break;
+				ev.x += (int32_t)UnZigZag(v);
+				if ((p = GetVarint(p, end, &v)) == NULL)
+					break;
+				ev.y += (int32_t)UnZigZag(v);
+				if ((p = GetVarint(p, end, &v)) == NULL)
+					break;
+				ev.hookTime += (uint32_t)UnZigZag(v);
+			}
+			if (func)
+				func(ctx, &ev);
+			count++;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Cursor flight recorder.
+ *
+ * The cursor samples of the mouse hook and the update/paint events are
+ * pushed into a single producer, single consumer ring by the window
+ * thread. A background thread pops them and appends them to a size
+ * capped file, which is made of segments written in rotation. The
+ * records are delta and varint encoded.
+ *
+ * This part does not depend on Win32, so that the recording can be
+ * decoded on Linux.
+ *
+ * File format (little endian):
+ *   File header, FLIGHT_FILE_HEADER bytes
+ *     "XEFR", version, segment size, segment count, tick frequency,
+ *     dropped events
+ *   Segment 0 .. segment count - 1, segment size bytes each
+ *     Segment header, FLIGHT_SEGMENT_HEADER bytes
+ *       "XESG", used bytes, sequence number (0 if empty),
+ *       base time, base x, base y, base hook time
+ *     Records
+ *       type, varint time delta, and for FR_CURSOR
+ *       zigzag varint x, y and hook time deltas
+ */
+
+#ifndef _WINEYES_FLIGHT_H_
+#define _WINEYES_FLIGHT_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLIGHT_VERSION         1
+#define FLIGHT_FILE_HEADER     64
+#define FLIGHT_SEGMENT_HEADER  40
+#define FLIGHT_SEGMENT_SIZE    (64 * 1024)
+#define FLIGHT_MIN_SEGMENTS    2
+#define FLIGHT_MAX_RECORD      26
+
+//
+// Ring capacity, power of 2.
+//
+#define FLIGHT_RING_SIZE       4096
+
+enum flightRecordType {
+	FR_CURSOR = 1,      // Cursor sample of the mouse hook
+	FR_UPDATE = 2,      // The eyeballs are redrawn
+	FR_UPDATE_SKIP = 3, // The cursor did not move, nothing is drawn
+	FR_PAINT = 4,       // The face is painted
+};
+
+struct FlightEvent {
+	uint64_t time;      // Timestamp in ticks
+	int32_t  x;         // Cursor position in screen coordinates
+	int32_t  y;
+	uint32_t hookTime;  // Timestamp of the hook in milliseconds
+	uint32_t type;
+};
+
+struct FlightRing {
+	alignas(64) std::atomic<uint32_t> head;     // Written by the producer
+	alignas(64) std::atomic<uint32_t> tail;     // Written by the consumer
+	alignas(64) std::atomic<uint32_t> dropped;  // Events lost on overflow
+	struct FlightEvent ev[FLIGHT_RING_SIZE];
+};
+
+void FlightRingInit(struct FlightRing *ring);
+
+//
+// Called by the producer only. The event is dropped when the ring is full.
+//
+static inline bool FlightRingPush(struct FlightRing *ring, const struct FlightEvent *ev)
+{
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+
+	if (head - ring->tail.load(std::memory_order_acquire) >= FLIGHT_RING_SIZE) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	ring->ev[head & (FLIGHT_RING_SIZE - 1)] = *ev;
+	ring->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+//
+// Called by the consumer only. Returns the number of events popped.
+//
+int FlightRingPop(struct FlightRing *ring, struct FlightEvent *out, int max);
+
+struct FlightWriter {
+	uint8_t *base;          // Mapped file
+	size_t   size;
+	uint32_t segmentCount;
+	uint32_t segment;       // Current segment
+	uint64_t sequence;      // Sequence number of the current segment
+	size_t   pos;           // Write position in the current segment
+	struct FlightEvent prev;
+};
+
+//
+// Size of the file which holds at most 'bytes'.
+//
+size_t FlightFileSize(size_t bytes);
+
+//
+// Format the mapped file of FlightFileSize() bytes.
+//
+bool FlightWriterInit(struct FlightWriter *w, uint8_t *base, size_t size, uint64_t tickFrequency);
+void FlightWriterAppend(struct FlightWriter *w, const struct FlightEvent *ev, int n);
+void FlightWriterSetDropped(struct FlightWriter *w, uint32_t dropped);
+
+struct FlightInfo {
+	uint64_t tickFrequency;   // Ticks per second of FlightEvent.time
+	uint32_t segmentCount;
+	uint32_t dropped;         // Events lost on ring overflow
+};
+
+//
+// Decode the file. The events are passed to the callback in the recorded
+// order, beginning from the oldest segment. Returns the number of events,
+// or -1 if the file is not a flight recording.
+//
+typedef void (*FlightDecodeFunc)(void *ctx, const struct FlightEvent *ev);
+long long FlightDecode(const uint8_t *base, size_t size, struct FlightInfo *info,
+	FlightDecodeFunc func, void *ctx);
+
+#endif   /* _WINEYES_FLIGHT_H_ */
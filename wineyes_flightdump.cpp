@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Offline decoder of the cursor flight recording.
+ *
+ * Usage:
+ *   wineyes_flightdump [-trace] FILE
+ *     Print one event per line:
+ *       TIME_MS TYPE X Y HOOK_MS
+ *     -trace: print the cursor samples as the cursor trace of -export:
+ *       TIME_MS X Y
+ *
+ * TIME_MS is relative to the first event.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "wineyes_flight.h"
+
+struct DumpContext {
+	bool     trace;
+	bool     first;
+	uint64_t start;
+	double   msPerTick;
+	long long count[FR_PAINT + 1];
+};
+
+static const char *TypeName(uint32_t type)
+{
+	switch (type) {
+	case FR_CURSOR:      return "cursor";
+	case FR_UPDATE:      return "update";
+	case FR_UPDATE_SKIP: return "update_skip";
+	case FR_PAINT:       return "paint";
+	default:             return "unknown";
+	}
+}
+
+static void DumpEvent(void *param, const struct FlightEvent *ev)
+{
+	struct DumpContext *ctx = (struct DumpContext *)param;
+	double ms;
+
+	if (ctx->first) {
+		ctx->start = ev->time;
+		ctx->first = false;
+	}
+	ms = (double)(ev->time - ctx->start) * ctx->msPerTick;
+	if (ev->type <= FR_PAINT)
+		ctx->count[ev->type]++;
+
+	if (ctx->trace) {
+		if (ev->type == FR_CURSOR)
+			printf("%lld %d %d\n", (long long)ms, ev->x, ev->y);
+	}
+	else {
+		printf("%.3f %s %d %d %u\n", ms, TypeName(ev->type), ev->x, ev->y, ev->hookTime);
+	}
+}
+
+static bool ReadFile(const char *path, std::vector<uint8_t> *buf)
+{
+	FILE *fp = fopen(path, "rb");
+	uint8_t chunk[65536];
+	size_t n;
+
+	if (fp == NULL)
+		return false;
+	while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+		buf->insert(buf->end(), chunk, chunk + n);
+	fclose(fp);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	struct DumpContext ctx;
+	struct FlightInfo info;
+	std::vector<uint8_t> buf;
+	const char *path = NULL;
+	long long n;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.first = true;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-trace") == 0)
+			ctx.trace = true;
+		else
+			path = argv[i];
+	}
+	if (path == NULL) {
+		fprintf(stderr, "usage: wineyes_flightdump [-trace] FILE\n");
+		return 2;
+	}
+
+	if (!ReadFile(path, &buf)) {
+		fprintf(stderr, "%s: cannot read\n", path);
+		return 1;
+	}
+
+	//
+	// The tick frequency is needed before decoding the events.
+	//
+	if (FlightDecode(buf.data(), buf.size(), &info, NULL, NULL) < 0 || info.tickFrequency == 0) {
+		fprintf(stderr, "%s: not a flight recording\n", path);
+		return 1;
+	}
+	ctx.msPerTick = 1000.0 / (double)info.tickFrequency;
+
+	if (ctx.trace)
+		printf("# TIME_MS X Y\n");
+	n = FlightDecode(buf.data(), buf.size(), &info, DumpEvent, &ctx);
+
+	fprintf(stderr, "events=%lld cursor=%lld update=%lld update_skip=%lld paint=%lld dropped=%u bytes=%zu\n",
+		n, ctx.count[FR_CURSOR], ctx.count[FR_UPDATE], ctx.count[FR_UPDATE_SKIP],
+		ctx.count[FR_PAINT], info.dropped, buf.size());
+	return 0;
+}
@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Forwarding of a launch to the running instance.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "wineyes_launch.h"
+
+static void Put16(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void Put32(uint8_t *p, uint32_t v)
+{
+	Put16(p, v);
+	Put16(p + 2, v >> 16);
+}
+
+static uint32_t Get16(const uint8_t *p)
+{
+	return p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+	return Get16(p) | Get16(p + 2) << 16;
+}
+
+static uint32_t Checksum(const uint8_t *p, size_t n)
+{
+	uint32_t h = 2166136261u;
+
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+//
+// UTF-16 code units of a character. wchar_t is UTF-16 on Windows and
+// UTF-32 elsewhere.
+//
+static int Utf16(wchar_t c, uint16_t units[2])
+{
+	uint32_t v = (uint32_t)c;
+
+	if (v > 0x10ffff)
+		v = 0xfffd;
+	if (v < 0x10000) {
+		units[0] = (uint16_t)v;
+		return 1;
+	}
+	v -= 0x10000;
+	units[0] = (uint16_t)(0xd800 + (v >> 10));
+	units[1] = (uint16_t)(0xdc00 + (v & 0x3ff));
+	return 2;
+}
+
+size_t EyesLaunchEncode(int argc, wchar_t **argv, uint8_t *buf, size_t size)
+{
+	size_t pos = LAUNCH_HEADER_BYTES;
+
+	if (argc < 0 || argc > LAUNCH_MAX_ARGS)
+		return 0;
+	if (size > LAUNCH_MAX_BYTES)
+		size = LAUNCH_MAX_BYTES;
+	if (buf == NULL)
+		size = LAUNCH_MAX_BYTES;
+
+	for (int i = 0; i < argc; i++) {
+		size_t lenPos = pos;
+		uint32_t len = 0;
+
+		pos += 2;
+		for (const wchar_t *s = argv[i]; *s; s++) {
+			uint16_t units[2];
+			int n = Utf16(*s, units);
+
+			if (pos + 2 * n > size)
+				return 0;
+			for (int k = 0; k < n; k++, pos += 2) {
+				if (buf)
+					Put16(buf + pos, units[k]);
+			}
+			len += n;
+		}
+		if (pos > size || len > 0xffff)
+			return 0;
+		if (buf)
+			Put16(buf + lenPos, len);
+	}
+	if (pos > size)
+		return 0;
+
+	if (buf) {
+		Put32(buf, LAUNCH_MAGIC);
+		Put16(buf + 4, LAUNCH_VERSION);
+		Put16(buf + 6, (uint32_t)argc);
+		Put32(buf + 8, (uint32_t)(pos - LAUNCH_HEADER_BYTES));
+		Put32(buf + 12, Checksum(buf + LAUNCH_HEADER_BYTES, pos - LAUNCH_HEADER_BYTES));
+	}
+	return pos;
+}
+
+bool EyesLaunchDecode(const uint8_t *buf, size_t size, struct EyesOptions *opt)
+{
+	const uint8_t *payload;
+	wchar_t *argv[LAUNCH_MAX_ARGS];
+	wchar_t *text, *out;
+	size_t bytes, pos = 0;
+	int argc;
+
+	if (buf == NULL || size < LAUNCH_HEADER_BYTES || size > LAUNCH_MAX_BYTES)
+		return false;
+	payload = buf + LAUNCH_HEADER_BYTES;
+	if (Get32(buf) != LAUNCH_MAGIC || Get16(buf + 4) != LAUNCH_VERSION)
+		return false;
+	argc = (int)Get16(buf + 6);
+	bytes = Get32(buf + 8);
+	if (argc > LAUNCH_MAX_ARGS || bytes != size - LAUNCH_HEADER_BYTES)
+		return false;
+	if (Get32(buf + 12) != Checksum(payload, bytes))
+		return false;
+
+	//
+	// The strings never take more characters than the code units and
+	// the terminators.
+	//
+	text = (wchar_t *)malloc((bytes / 2 + argc + 1) * sizeof(wchar_t));
+	if (text == NULL)
+		return false;
+	out = text;
+
+	for (int i = 0; i < argc; i++) {
+		size_t len, end;
+
+		if (pos + 2 > bytes) {
+			free(text);
+			return false;
+		}
+		len = Get16(payload + pos);
+		pos += 2;
+		end = pos + 2 * len;
+		if (end > bytes) {
+			free(text);
+			return false;
+		}
+
+		argv[i] = out;
+		while (pos < end) {
+			uint32_t c = Get16(payload + pos);
+
+			pos += 2;
+			if (sizeof(wchar_t) > 2 && c >= 0xd800 && c < 0xdc00 && pos < end) {
+				uint32_t lo = Get16(payload + pos);
+
+				if (lo >= 0xdc00 && lo < 0xe000) {
+					c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+					pos += 2;
+				}
+			}
+			*out++ = (wchar_t)c;
+		}
+		*out++ = L'\0';
+	}
+	if (pos != bytes) {
+		free(text);
+		return false;
+	}
+
+	EyesParseOptions(argc, argv, opt);
+	free(text);
+	return true;
+}
+
+bool EyesLaunchForwardable(const struct EyesOptions *opt)
+{
+	return !opt->exportMode && opt->recordPath[0] == L'\0' && !opt->newInstance;
+}
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Forwarding of a launch to the running instance.
+ *
+ * A second xeyes.exe does not start another process with its own hook.
+ * It passes its command line to the running instance, which opens one
+ * more pair of eyes, and exits. The command line is sent as a message
+ * of UTF-16LE strings, so that it is independent of the size of wchar_t,
+ * and the receiver parses it with EyesParseOptions(). On Windows the
+ * message is carried by WM_COPYDATA. This part does not depend on Win32.
+ */
+
+#ifndef _WINEYES_LAUNCH_H_
+#define _WINEYES_LAUNCH_H_
+
+#include "wineyes_core.h"
+
+//
+// Message layout, in little endian:
+//   uint32 magic, uint16 version, uint16 argc,
+//   uint32 payload bytes, uint32 FNV-1a checksum of the payload,
+//   argc x { uint16 length, length x uint16 UTF-16 code unit }
+//
+#define LAUNCH_MAGIC        0x4e4c4558   // "XELN"
+#define LAUNCH_VERSION      1
+#define LAUNCH_HEADER_BYTES 16
+#define LAUNCH_MAX_ARGS     64
+#define LAUNCH_MAX_BYTES    32768
+
+//
+// Encode the arguments, which do not include the program name.
+// Returns the size of the message, or 0 if it does not fit in 'size'
+// bytes or LAUNCH_MAX_BYTES. If 'buf' is NULL the size is only counted.
+//
+size_t EyesLaunchEncode(int argc, wchar_t **argv, uint8_t *buf, size_t size);
+
+//
+// Check and decode a message, and parse the arguments into 'opt'.
+// Returns false for a broken or foreign message, and 'opt' is not
+// touched then.
+//
+bool EyesLaunchDecode(const uint8_t *buf, size_t size, struct EyesOptions *opt);
+
+//
+// Whether the launch is forwarded to the running instance. The export
+// and the flight recording belong to the process, so that they are run
+// by a new one, as well as -newinstance.
+//
+bool EyesLaunchForwardable(const struct EyesOptions *opt);
+
+#endif   /* _WINEYES_LAUNCH_H_ */
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Face layout engine.
+ *
+ * The geometry of the face is described once by EyesFace, which is
+ * parameterized by the number of eyes and the shape. Every value is
+ * a constexpr function of the client size in integer arithmetic, so
+ * that the layout can be checked at compile time. The window region,
+ * the paint and the line of sight all use the EyesLayout filled by
+ * EyesFace::Compute() once per resize.
+ */
+
+#ifndef _WINEYES_LAYOUT_H_
+#define _WINEYES_LAYOUT_H_
+
+#include "wineyes_core.h"
+
+//
+// Version of the face geometry. It is bumped whenever EyesFace or the
+// shape is changed, so that the render caches of the old face are not
+// used (wineyes_cache.h).
+//
+#define EYES_LAYOUT_VERSION 1
+
+//
+// Shape of the original WinEyes face, given as integer ratios.
+//
+struct EyesDefaultShape {
+	//
+	// Half of the gap between the eyes is width * gapNum / gapDen.
+	//
+	static constexpr int gapNum = 1;
+	static constexpr int gapDen = 40;
+	//
+	// The white of the eyes is inset by width / eyes / scleraX
+	// horizontally, and height / scleraY vertically.
+	//
+	static constexpr int scleraX = 10;
+	static constexpr int scleraY = 10;
+	//
+	// Travel of the pupil is the radius of the white * 10 / 17.
+	//
+	static constexpr int travelNum = 10;
+	static constexpr int travelDen = 17;
+	//
+	// Radius of the pupil is the travel * 2 / 5.
+	//
+	static constexpr int pupilNum = 2;
+	static constexpr int pupilDen = 5;
+};
+
+template <int Eyes, class Shape = EyesDefaultShape>
+struct EyesFace {
+	static_assert(Eyes >= 1, "At least one eye is needed");
+
+	static constexpr int eyes = Eyes;
+
+	static constexpr int CeilDiv(int a, int b) { return (a + b - 1) / b; }
+
+	//
+	// Outline of eye k. It is also the window region of the eye.
+	//
+	static constexpr int EyeRight(int w, int k)
+	{
+		return k == Eyes - 1 ? w - 1 : (k + 1) * w / Eyes - CeilDiv(w * Shape::gapNum, Shape::gapDen);
+	}
+	static constexpr int EyeLeft(int w, int k)
+	{
+		return k == 0 ? 1 : EyeRight(w, k - 1) + 2 * w * Shape::gapNum / Shape::gapDen;
+	}
+	static constexpr int EyeTop(int) { return 1; }
+	static constexpr int EyeBottom(int h) { return h; }
+
+	//
+	// White of eye k.
+	//
+	static constexpr int ScleraLeft(int w, int k) { return EyeLeft(w, k) + w / Eyes / Shape::scleraX; }
+	static constexpr int ScleraRight(int w, int k) { return EyeRight(w, k) - w / Eyes / Shape::scleraX; }
+	static constexpr int ScleraTop(int h) { return EyeTop(h) + h / Shape::scleraY; }
+	static constexpr int ScleraBottom(int h) { return EyeBottom(h) - h / Shape::scleraY; }
+
+	//
+	// Center of the line of sight of eye k.
+	//
+	static constexpr int CenterX(int w, int k) { return (ScleraLeft(w, k) + ScleraRight(w, k)) / 2 + 1; }
+	static constexpr int CenterY(int h) { return (ScleraTop(h) + ScleraBottom(h)) / 2 + 1; }
+
+	//
+	// Travel and radius of the pupils. They are given by the first eye.
+	//
+	static constexpr int TravelX(int w)
+	{
+		return (ScleraRight(w, 0) - ScleraLeft(w, 0)) / 2 * Shape::travelNum / Shape::travelDen;
+	}
+	static constexpr int TravelY(int h)
+	{
+		return (ScleraBottom(h) - ScleraTop(h)) / 2 * Shape::travelNum / Shape::travelDen;
+	}
+	static constexpr int PupilX(int w) { return TravelX(w) * Shape::pupilNum / Shape::pupilDen; }
+	static constexpr int PupilY(int h) { return TravelY(h) * Shape::pupilNum / Shape::pupilDen; }
+
+	//
+	// Fill the layout of a client area. Only Eyes == NUM_EYES fits
+	// in EyesLayout.
+	//
+	static void Compute(int w, int h, struct EyesLayout *layout)
+	{
+		static_assert(Eyes == NUM_EYES, "EyesLayout holds NUM_EYES eyes");
+
+		layout->size.x = w;
+		layout->size.y = h;
+		for (int k = 0; k < Eyes; k++) {
+			layout->outline[k].left = EyeLeft(w, k);
+			layout->outline[k].right = EyeRight(w, k);
+			layout->outline[k].top = EyeTop(h);
+			layout->outline[k].bottom = EyeBottom(h);
+			layout->sclera[k].left = ScleraLeft(w, k);
+			layout->sclera[k].right = ScleraRight(w, k);
+			layout->sclera[k].top = ScleraTop(h);
+			layout->sclera[k].bottom = ScleraBottom(h);
+			layout->center[k].x = CenterX(w, k);
+			layout->center[k].y = CenterY(h);
+		}
+		layout->eyesize.x = TravelX(w);
+		layout->eyesize.y = TravelY(h);
+		layout->eyeballsize.x = PupilX(w);
+		layout->eyeballsize.y = PupilY(h);
+	}
+};
+
+typedef EyesFace<NUM_EYES> EyesDefaultFace;
+
+#endif   /* _WINEYES_LAYOUT_H_ */
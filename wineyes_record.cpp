@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Cursor flight recorder.
+ *
+ * The window thread pushes the events into the ring by FlightRecord().
+ * The recorder thread drains the ring every FLIGHT_DRAIN_MS and appends
+ * the events to the memory-mapped file.
+ */
+
+#include <windows.h>
+#include "wineyes.h"
+
+//
+// Interval of draining the ring.
+// Each 1000Hz mouse event takes a cursor and an update or skip entry,
+// so that the ring holds about 2 seconds of them.
+//
+#define FLIGHT_DRAIN_MS 50
+
+struct FlightRing *g_flightRing;
+
+static struct FlightRing g_ring;
+static struct FlightWriter g_writer;
+static HANDLE g_hFile = INVALID_HANDLE_VALUE;
+static HANDLE g_hMapping;
+static HANDLE g_hStop;
+static HANDLE g_hThread;
+static uint8_t *g_view;
+
+static void FlightDrain(void)
+{
+	struct FlightEvent ev[256];
+	int n;
+
+	while ((n = FlightRingPop(&g_ring, ev, 256)) > 0)
+		FlightWriterAppend(&g_writer, ev, n);
+	FlightWriterSetDropped(&g_writer, g_ring.dropped.load(std::memory_order_relaxed));
+}
+
+static DWORD WINAPI FlightRecorderThread(LPVOID param)
+{
+	for (;;) {
+		DWORD ret = WaitForSingleObject(g_hStop, FLIGHT_DRAIN_MS);
+		FlightDrain();
+		if (ret == WAIT_OBJECT_0)
+			break;
+	}
+	return 0;
+}
+
+static void FlightRecorderClose(void)
+{
+	if (g_view) {
+		FlushViewOfFile(g_view, 0);
+		UnmapViewOfFile(g_view);
+		g_view = NULL;
+	}
+	if (g_hMapping) {
+		CloseHandle(g_hMapping);
+		g_hMapping = NULL;
+	}
+	if (g_hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(g_hFile);
+		g_hFile = INVALID_HANDLE_VALUE;
+	}
+	if (g_hStop) {
+		CloseHandle(g_hStop);
+		g_hStop = NULL;
+	}
+}
+
+//
+// Start recording into the file which holds at most 'bytes'.
+// The file is overwritten.
+//
+bool FlightRecorderStart(const WCHAR *path, size_t bytes)
+{
+	LARGE_INTEGER freq;
+	size_t size = FlightFileSize(bytes);
+
+	g_hFile = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (g_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	g_hMapping = CreateFileMappingW(g_hFile, NULL, PAGE_READWRITE,
+		(DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+	if (g_hMapping == NULL) {
+		FlightRecorderClose();
+		return false;
+	}
+	g_view = (uint8_t *)MapViewOfFile(g_hMapping, FILE_MAP_WRITE, 0, 0, size);
+	if (g_view == NULL) {
+		FlightRecorderClose();
+		return false;
+	}
+
+	QueryPerformanceFrequency(&freq);
+	FlightWriterInit(&g_writer, g_view, size, (uint64_t)freq.QuadPart);
+	FlightRingInit(&g_ring);
+
+	g_hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (g_hStop == NULL) {
+		FlightRecorderClose();
+		return false;
+	}
+	g_hThread = CreateThread(NULL, 0, FlightRecorderThread, NULL, 0, NULL);
+	if (g_hThread == NULL) {
+		FlightRecorderClose();
+		return false;
+	}
+
+	g_flightRing = &g_ring;
+	return true;
+}
+
+void FlightRecorderStop(void)
+{
+	if (g_flightRing == NULL)
+		return;
+
+	g_flightRing = NULL;
+	SetEvent(g_hStop);
+	WaitForSingleObject(g_hThread, INFINITE);
+	CloseHandle(g_hThread);
+	g_hThread = NULL;
+
+	FlightRecorderClose();
+}
@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Bandwidth budget of the remote desktop session.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "wineyes_remote.h"
+
+void EyesBudgetInit(struct EyesBudget *b, int fps, int bytesPerSec, int grid, long long now)
+{
+	memset(b, 0, sizeof(*b));
+	b->interval = fps > 0 ? 1000 / fps : 0;
+	b->rate = bytesPerSec > 0 ? bytesPerSec : 1;
+	//
+	// A second of the budget can be spent at once.
+	//
+	b->burst = b->rate;
+	b->grid = grid > 0 ? grid : 1;
+	b->credit = b->burst * 1000;
+	b->refilled = now;
+	b->lastSent = now - b->interval;
+}
+
+//
+// Snap toward the center. The pupil is on the ellipse of the travel,
+// and a point with smaller offsets on both axes is inside of it.
+//
+static int Snap(int pos, int center, int step)
+{
+	int rel = pos - center;
+	int q = rel >= 0 ? rel / step : -(-rel / step);
+
+	return center + q * step;
+}
+
+void EyesBudgetQuantize(const struct EyesBudget *b, const struct EyesLayout *layout,
+	struct EyesPoint pupil[NUM_EYES])
+{
+	int step = b->grid * SUBPIXEL_ONE;
+
+	for (int i = 0; i < NUM_EYES; i++) {
+		pupil[i].x = Snap(pupil[i].x, layout->center[i].x * SUBPIXEL_ONE, step);
+		pupil[i].y = Snap(pupil[i].y, layout->center[i].y * SUBPIXEL_ONE, step);
+	}
+}
+
+static void Refill(struct EyesBudget *b, long long now, long long cap)
+{
+	if (now > b->refilled) {
+		b->credit += (now - b->refilled) * b->rate;
+		if (b->credit > cap * 1000)
+			b->credit = cap * 1000;
+	}
+	b->refilled = now;
+}
+
+void EyesBudgetCharge(struct EyesBudget *b, long long now, long long cost)
+{
+	Refill(b, now, b->burst);
+	b->credit -= cost * 1000;
+	b->lastSent = now;
+	b->pending = false;
+	b->sent++;
+	b->bytes += cost;
+}
+
+int EyesBudgetRequest(struct EyesBudget *b, long long now, long long cost)
+{
+	long long need = cost * 1000, wait = 0;
+
+	//
+	// An update larger than the burst saves up the credit for itself.
+	//
+	Refill(b, now, cost > b->burst ? cost : b->burst);
+	if (now - b->lastSent < b->interval)
+		wait = b->interval - (now - b->lastSent);
+	if (b->credit < need) {
+		long long refill = (need - b->credit + b->rate - 1) / b->rate;
+		if (refill > wait)
+			wait = refill;
+	}
+
+	if (wait > 0) {
+		if (!b->pending)
+			b->deferred++;
+		b->pending = true;
+		return wait > 0x7fffffff ? 0x7fffffff : (int)wait;
+	}
+
+	EyesBudgetCharge(b, now, cost);
+	return 0;
+}
+
+struct EyesRect EyesPupilRect(struct EyesPoint pupil, struct EyesPoint ebsize)
+{
+	struct EyesRect r;
+	int x = (pupil.x + SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT;
+	int y = (pupil.y + SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT;
+
+	r.left = x - ebsize.x - 1;
+	r.top = y - ebsize.y - 1;
+	r.right = r.left + 2 * ebsize.x + 2;
+	r.bottom = r.top + 2 * ebsize.y + 2;
+	return r;
+}
+
+static long long Area(const struct EyesRect *r)
+{
+	if (r->left >= r->right || r->top >= r->bottom)
+		return 0;
+	return (long long)(r->right - r->left) * (r->bottom - r->top);
+}
+
+long long EyesPupilDamage(const struct EyesRect prev[NUM_EYES], const struct EyesRect next[NUM_EYES])
+{
+	long long pixels = 0;
+
+	for (int i = 0; i < NUM_EYES; i++) {
+		struct EyesRect o;
+
+		o.left = prev[i].left > next[i].left ? prev[i].left : next[i].left;
+		o.top = prev[i].top > next[i].top ? prev[i].top : next[i].top;
+		o.right = prev[i].right < next[i].right ? prev[i].right : next[i].right;
+		o.bottom = prev[i].bottom < next[i].bottom ? prev[i].bottom : next[i].bottom;
+		pixels += Area(&prev[i]) + Area(&next[i]) - Area(&o);
+	}
+	return pixels * REMOTE_BYTES_PER_PIXEL;
+}
+
+//
+// Pixels of row y which the pupil centered at 'c' touches, and those
+// which it covers entirely. An empty span has x0 >= x1.
+//
+static void PupilRow(struct EyesPoint c, struct EyesPoint r, int y, int touched[2], int full[2])
+{
+	double cx = (double)c.x / SUBPIXEL_ONE, cy = (double)c.y / SUBPIXEL_ONE;
+	double near, far, hw;
+
+	touched[0] = touched[1] = full[0] = full[1] = 0;
+	near = cy < y ? y - cy : cy > y + 1 ? cy - (y + 1) : 0;
+	far = fabs(y - cy) > fabs(y + 1 - cy) ? fabs(y - cy) : fabs(y + 1 - cy);
+	if (near >= r.y)
+		return;
+
+	hw = r.x * sqrt(1.0 - (near / r.y) * (near / r.y));
+	touched[0] = (int)floor(cx - hw);
+	touched[1] = (int)ceil(cx + hw);
+	if (far < r.y) {
+		hw = r.x * sqrt(1.0 - (far / r.y) * (far / r.y));
+		full[0] = (int)ceil(cx - hw);
+		full[1] = (int)floor(cx + hw);
+	}
+}
+
+static int SpanLength(int x0, int x1)
+{
+	return x1 > x0 ? x1 - x0 : 0;
+}
+
+long long EyesPupilChange(const struct EyesPoint *prev, const struct EyesPoint next[NUM_EYES],
+	struct EyesPoint ebsize)
+{
+	long long pixels = 0;
+
+	if (ebsize.x < 1 || ebsize.y < 1)
+		return 0;
+
+	for (int i = 0; i < NUM_EYES; i++) {
+		int top = (next[i].y >> SUBPIXEL_SHIFT) - ebsize.y - 1;
+		int bottom = (next[i].y >> SUBPIXEL_SHIFT) + ebsize.y + 2;
+
+		if (prev) {
+			if (prev[i].x == next[i].x && prev[i].y == next[i].y)
+				continue;
+			if ((prev[i].y >> SUBPIXEL_SHIFT) - ebsize.y - 1 < top)
+				top = (prev[i].y >> SUBPIXEL_SHIFT) - ebsize.y - 1;
+			if ((prev[i].y >> SUBPIXEL_SHIFT) + ebsize.y + 2 > bottom)
+				bottom = (prev[i].y >> SUBPIXEL_SHIFT) + ebsize.y + 2;
+		}
+
+		for (int y = top; y < bottom; y++) {
+			int ta[2], fa[2], tb[2], fb[2];
+
+			PupilRow(next[i], ebsize, y, tb, fb);
+			if (prev == NULL) {
+				pixels += SpanLength(tb[0], tb[1]);
+				continue;
+			}
+			PupilRow(prev[i], ebsize, y, ta, fa);
+
+			//
+			// The union of the touched pixels, less the pixels which
+			// stay covered.
+			//
+			pixels += SpanLength(ta[0], ta[1]) + SpanLength(tb[0], tb[1]) -
+				SpanLength(ta[0] > tb[0] ? ta[0] : tb[0], ta[1] < tb[1] ? ta[1] : tb[1]) -
+				SpanLength(fa[0] > fb[0] ? fa[0] : fb[0], fa[1] < fb[1] ? fa[1] : fb[1]);
+		}
+	}
+	return pixels * REMOTE_BYTES_PER_PIXEL;
+}
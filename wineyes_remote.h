@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Bandwidth budget of the remote desktop session.
+ *
+ * Every eyeball update is sent over the wire as the damaged pixels.
+ * In the remote mode the pupils are snapped to a coarser grid, and the
+ * updates are limited to a rate and a bytes/second budget which is
+ * kept by a token bucket. An update is charged for the pixels which
+ * the pupils can change, as the remote desktop protocols send only
+ * what differs from the last frame, rather than for the whole cells.
+ * An update which does not fit is held back, and the caller retries
+ * after the returned delay with the latest cursor position, so that
+ * the resting position is always sent.
+ * This part does not depend on Win32.
+ */
+
+#ifndef _WINEYES_REMOTE_H_
+#define _WINEYES_REMOTE_H_
+
+#include "wineyes_core.h"
+
+//
+// The damage is accounted in 32bit pixels.
+//
+#define REMOTE_BYTES_PER_PIXEL 4
+
+struct EyesBudget {
+	int       interval;     // Minimum interval of the updates in ms
+	long long rate;         // Budget in bytes/second
+	long long burst;        // Maximum credit in bytes
+	int       grid;         // Pupil grid in pixels
+	long long credit;       // Credit in 1/1000 bytes
+	long long refilled;     // Time of the last refill in ms
+	long long lastSent;     // Time of the last update in ms
+	bool      pending;      // An update is held back
+
+	long long sent;         // Number of the updates sent
+	long long deferred;     // Number of the updates held back
+	long long bytes;        // Bytes of the damage sent
+};
+
+void EyesBudgetInit(struct EyesBudget *b, int fps, int bytesPerSec, int grid, long long now);
+
+//
+// Snap the pupils to the grid around the centers of the eyes. They are
+// snapped toward the centers, so that they stay within the travel.
+//
+void EyesBudgetQuantize(const struct EyesBudget *b, const struct EyesLayout *layout,
+	struct EyesPoint pupil[NUM_EYES]);
+
+//
+// Request to send an update of 'cost' bytes at 'now' ms.
+// Returns 0 if it is sent and charged, otherwise the delay in ms after
+// which the caller should retry.
+//
+int EyesBudgetRequest(struct EyesBudget *b, long long now, long long cost);
+
+//
+// Charge an update which is sent regardless of the budget, such as
+// the paint of the whole face.
+//
+void EyesBudgetCharge(struct EyesBudget *b, long long now, long long cost);
+
+//
+// Bounding rectangle of the pupil drawn at 'pupil' in 1/SUBPIXEL_ONE
+// pixel, which is the cell of the pupil atlas.
+//
+struct EyesRect EyesPupilRect(struct EyesPoint pupil, struct EyesPoint ebsize);
+
+//
+// Bytes of the damage which moves the pupils from 'prev' to 'next'.
+// An empty 'prev' rectangle is not counted.
+//
+long long EyesPupilDamage(const struct EyesRect prev[NUM_EYES], const struct EyesRect next[NUM_EYES]);
+
+//
+// Bytes of the pixels which may change when the pupils of the radius
+// 'ebsize' move from 'prev' to 'next', in 1/SUBPIXEL_ONE pixel. The
+// pixels which are covered by the pupil in both are not counted. If
+// 'prev' is NULL, nothing is drawn yet.
+//
+long long EyesPupilChange(const struct EyesPoint *prev, const struct EyesPoint next[NUM_EYES],
+	struct EyesPoint ebsize);
+
+#endif   /* _WINEYES_REMOTE_H_ */
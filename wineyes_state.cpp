@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * This software is based on WinEyes 1.2.
+ * Special thanks to Robert W. Buccigrossi.
+ */
+
+#include <string.h>
+#include "wineyes_state.h"
+
+void EyesStateInit(struct EyesState *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->mouseState = EMS_NONE;
+	//
+	// Displaying menu bar by default.
+	//
+	st->showMenu = 1;
+	st->resetClippingRegion = 1;
+	//
+	// Setup the window to be topmost by default.
+	//
+	st->showTopMost = true;
+}
+
+static void AddEffect(struct EyesEffect *effects, int *n, enum EyesEffectType type)
+{
+	effects[*n].type = type;
+	memset(&effects[*n].rect, 0, sizeof(effects[*n].rect));
+	(*n)++;
+}
+
+int EyesStateHandle(struct EyesState *st, const struct EyesEvent *ev, struct EyesEffect effects[EYES_MAX_EFFECTS])
+{
+	int n = 0;
+
+	switch (ev->type)
+	{
+	case EV_PAINT:
+	case EV_MOVE:
+		if (st->resetClippingRegion) {
+			AddEffect(effects, &n, EF_SET_REGION);
+			st->resetClippingRegion = 0;
+		}
+		AddEffect(effects, &n, EF_PAINT);
+		break;
+
+	case EV_SIZE:
+		st->resetClippingRegion = 1;
+		AddEffect(effects, &n, EF_REDRAW);
+		break;
+
+	case EV_LBUTTONDOWN:
+		st->mouseState = EMS_IN_MOVE;
+		st->drag = ev->pos;
+		AddEffect(effects, &n, EF_CAPTURE);
+		break;
+
+	case EV_LBUTTONUP:
+		if (st->mouseState == EMS_IN_MOVE) {
+			st->mouseState = EMS_NONE;
+			AddEffect(effects, &n, EF_RELEASE_CAPTURE);
+		}
+		break;
+
+	case EV_TOGGLE_MENU:
+		st->showMenu = st->showMenu ^ 1;
+		st->resetClippingRegion = 1;
+		AddEffect(effects, &n, EF_REDRAW);
+		break;
+
+	case EV_MOUSEMOVE:
+		//
+		// Changes the mouse cursor type while the cursor is
+		// moving over my application.
+		//
+		AddEffect(effects, &n, EF_SET_CURSOR);
+
+		//
+		// The entire application window is moved not just the frame
+		// while you are dragging.
+		//
+		if (st->mouseState == EMS_IN_MOVE) {
+			struct EyesPoint newmouseloc;
+
+			newmouseloc.x = ev->window.left + ev->pos.x;
+			newmouseloc.y = ev->window.top + ev->pos.y;
+			if ((newmouseloc.x != st->mouseloc.x) || (newmouseloc.y != st->mouseloc.y)) {
+				st->mouseloc = newmouseloc;
+				effects[n].type = EF_MOVE_WINDOW;
+				effects[n].rect.left = newmouseloc.x - st->drag.x;
+				effects[n].rect.top = newmouseloc.y - st->drag.y;
+				effects[n].rect.right = effects[n].rect.left + (ev->window.right - ev->window.left);
+				effects[n].rect.bottom = effects[n].rect.top + (ev->window.bottom - ev->window.top);
+				n++;
+			}
+		}
+		else {
+			AddEffect(effects, &n, EF_DEFAULT);
+		}
+		break;
+
+	case EV_DEFAULT_SIZE:
+		//
+		// Bug fix in original version:
+		// The eyeball is incorrectly rendered after resizing.
+		// So, the clipping area is to be reset and redrawn.
+		//
+		// Resizing sends WM_SIZE which already does it, and the face
+		// is painted once by WM_PAINT afterwards. Only when the size
+		// is not changed, it is done here.
+		//
+		if (ev->pos.x != DEFAULT_W || ev->pos.y != DEFAULT_H) {
+			effects[n].type = EF_RESIZE_CLIENT;
+			effects[n].rect.left = 0;
+			effects[n].rect.top = 0;
+			effects[n].rect.right = DEFAULT_W;
+			effects[n].rect.bottom = DEFAULT_H;
+			n++;
+		}
+		else {
+			st->resetClippingRegion = 1;
+			AddEffect(effects, &n, EF_REDRAW);
+		}
+		break;
+
+	case EV_TOGGLE_TOPMOST:
+		st->showTopMost = !st->showTopMost;
+		AddEffect(effects, &n, EF_SET_TOPMOST);
+		break;
+	}
+
+	return n;
+}
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Window state machine.
+ *
+ * The window messages are translated into EyesEvent, and the state
+ * machine returns the EyesEffect to be carried out by the window
+ * procedure in order. This part does not depend on Win32, so that
+ * message streams can be replayed headless.
+ */
+
+#ifndef _WINEYES_STATE_H_
+#define _WINEYES_STATE_H_
+
+#include "wineyes_core.h"
+
+enum EyesMouseState { EMS_NONE, EMS_IN_MOVE };
+
+struct EyesState {
+	enum EyesMouseState mouseState;
+	int  showMenu;              // Displaying the window frame
+	int  resetClippingRegion;   // The window region is to be rebuilt
+	bool showTopMost;           // Always on top
+	struct EyesPoint drag;      // Client position where the drag started
+	struct EyesPoint mouseloc;  // Last cursor position while dragging
+};
+
+enum EyesEventType {
+	EV_PAINT,           // WM_PAINT
+	EV_MOVE,            // WM_MOVE
+	EV_SIZE,            // WM_SIZE
+	EV_LBUTTONDOWN,     // WM_LBUTTONDOWN
+	EV_LBUTTONUP,       // WM_LBUTTONUP
+	EV_TOGGLE_MENU,     // WM_LBUTTONDBLCLK, WM_RBUTTONUP
+	EV_MOUSEMOVE,       // WM_MOUSEMOVE
+	EV_DEFAULT_SIZE,    // ID_DEFAULT_SIZE
+	EV_TOGGLE_TOPMOST,  // ID_ALWAYS_ON_TOP
+};
+
+struct EyesEvent {
+	enum EyesEventType type;
+	struct EyesPoint pos;       // Cursor position in client coordinates,
+	                            // or client size for EV_DEFAULT_SIZE
+	struct EyesRect window;     // Window rectangle in screen coordinates
+};
+
+enum EyesEffectType {
+	EF_SET_REGION,      // Rebuild the window region
+	EF_PAINT,           // Paint the face and the eyeballs
+	EF_REDRAW,          // Invalidate the whole window
+	EF_CAPTURE,         // Capture the mouse
+	EF_RELEASE_CAPTURE, // Release the mouse
+	EF_SET_CURSOR,      // Show the hand cursor
+	EF_MOVE_WINDOW,     // Move the window to rect.left, rect.top
+	EF_RESIZE_CLIENT,   // Resize the client area to rect.right, rect.bottom
+	EF_SET_TOPMOST,     // Apply showTopMost
+	EF_DEFAULT,         // Pass the message to DefWindowProc()
+	NUM_EFFECTS
+};
+
+struct EyesEffect {
+	enum EyesEffectType type;
+	struct EyesRect rect;
+};
+
+#define EYES_MAX_EFFECTS 4
+
+void EyesStateInit(struct EyesState *st);
+int EyesStateHandle(struct EyesState *st, const struct EyesEvent *ev, struct EyesEffect effects[EYES_MAX_EFFECTS]);
+
+#endif   /* _WINEYES_STATE_H_ */
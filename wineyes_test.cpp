@@ -0,0 +1,825 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Tests of the core.
+ * Returns non-zero if any check fails.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <new>
+#include <vector>
+#include "wineyes_core.h"
+#include "wineyes_state.h"
+#include "wineyes_flight.h"
+#include "wineyes_tile.h"
+#include "wineyes_cache.h"
+#include "wineyes_remote.h"
+#include "wineyes_launch.h"
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define TEST_PI 3.14159265358979323846
+
+static int g_failed;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		g_failed++; \
+	} \
+} while (0)
+
+//
+// Parse "-geometry ARG" into the defaults.
+//
+static struct EyesOptions Geometry(const wchar_t *arg)
+{
+	const wchar_t *argv[] = { L"-geometry", arg };
+	struct EyesOptions opt;
+
+	EyesParseOptions(2, (wchar_t **)argv, &opt);
+	return opt;
+}
+
+static void TestGeometry(void)
+{
+	struct EyesOptions opt;
+
+	opt = Geometry(L"300x200");
+	CHECK(opt.geometryWidth == 300 && opt.geometryHeight == 200);
+	CHECK(opt.geometryXoff == DEFAULT_X && opt.geometryYoff == DEFAULT_Y);
+
+	opt = Geometry(L"300x200+2000+700");
+	CHECK(opt.geometryWidth == 300 && opt.geometryHeight == 200);
+	CHECK(opt.geometryXoff == 2000 && opt.geometryYoff == 700);
+
+	opt = Geometry(L"+100+80");
+	CHECK(opt.geometryWidth == DEFAULT_W && opt.geometryHeight == DEFAULT_H);
+	CHECK(opt.geometryXoff == 100 && opt.geometryYoff == 80);
+
+	//
+	// An offset left of or above the primary monitor, as "%d" takes it.
+	//
+	opt = Geometry(L"300x200+-1920+-10");
+	CHECK(opt.geometryXoff == -1920 && opt.geometryYoff == -10);
+	opt = Geometry(L"+-5+-6");
+	CHECK(opt.geometryXoff == -5 && opt.geometryYoff == -6);
+
+	//
+	// Overflow saturates instead of wrapping around.
+	//
+	opt = Geometry(L"99999999999999999999x200");
+	CHECK(opt.geometryWidth > 0 && opt.geometryWidth < INT_MAX);
+	CHECK(opt.geometryHeight == 200);
+	opt = Geometry(L"+-99999999999999999999+0");
+	CHECK(opt.geometryXoff < 0 && opt.geometryXoff > INT_MIN);
+
+	//
+	// Garbage leaves the defaults.
+	//
+	static const wchar_t *garbage[] = {
+		L"", L"x", L"abc", L"300", L"300x", L"x200", L"+", L"++", L"+1", L"300*200", L"-",
+	};
+	for (const wchar_t *g : garbage) {
+		opt = Geometry(g);
+		CHECK(opt.geometryWidth == DEFAULT_W && opt.geometryHeight == DEFAULT_H);
+		CHECK(opt.geometryXoff == DEFAULT_X && opt.geometryYoff == DEFAULT_Y);
+	}
+
+	//
+	// The direct parser reports whether it matched.
+	//
+	CHECK(EyesParseGeometry(L"10x20", &opt));
+	CHECK(!EyesParseGeometry(L"garbage", &opt));
+}
+
+static void TestOptions(void)
+{
+	const wchar_t *argv[] = {
+		L"-monitor", L"2", L"-remote-fps", L"5000", L"-remote-grid", L"4", L"-geometry",
+	};
+	struct EyesOptions opt;
+
+	EyesParseOptions(7, (wchar_t **)argv, &opt);
+	CHECK(opt.monitorNumber == 2);
+	CHECK(opt.remoteFps == DEFAULT_REMOTE_FPS);     // Out of range
+	CHECK(opt.remoteGrid == 4);
+	CHECK(opt.geometryWidth == DEFAULT_W);           // No argument
+
+	CHECK(EyesParseMonitor(L"99", &opt) && opt.monitorNumber == DEFAULT_SCREEN_NO);
+	CHECK(!EyesParseMonitor(L"second", &opt));
+}
+
+static void TestAlignedAlloc(void)
+{
+	static const size_t aligns[] = { 1, 16, 64, 4096 };
+
+	for (size_t i = 0; i < sizeof(aligns) / sizeof(aligns[0]); i++) {
+		for (size_t size = 1; size <= 1000; size += 333) {
+			void *p = EyesAlignedAlloc(size, aligns[i]);
+
+			CHECK(p != NULL && (uintptr_t)p % aligns[i] == 0);
+			if (p)
+				memset(p, 0xa5, size);
+			EyesAlignedFree(p);
+		}
+	}
+	CHECK(EyesAlignedAlloc(SIZE_MAX, 64) == NULL);
+	EyesAlignedFree(NULL);
+}
+
+//
+// Run one event through the state machine.
+//
+static int Post(struct EyesState *st, enum EyesEventType type, int x, int y,
+	struct EyesEffect effects[EYES_MAX_EFFECTS])
+{
+	struct EyesEvent ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	ev.pos.x = x;
+	ev.pos.y = y;
+	ev.window.left = 100;
+	ev.window.top = 200;
+	ev.window.right = 100 + DEFAULT_W;
+	ev.window.bottom = 200 + DEFAULT_H;
+	return EyesStateHandle(st, &ev, effects);
+}
+
+static void TestState(void)
+{
+	struct EyesState st;
+	struct EyesEffect ef[EYES_MAX_EFFECTS];
+	int n;
+
+	EyesStateInit(&st);
+	CHECK(st.showMenu == 1 && st.showTopMost && st.resetClippingRegion);
+
+	//
+	// The region is built by the first paint only.
+	//
+	n = Post(&st, EV_PAINT, 0, 0, ef);
+	CHECK(n == 2 && ef[0].type == EF_SET_REGION && ef[1].type == EF_PAINT);
+	n = Post(&st, EV_PAINT, 0, 0, ef);
+	CHECK(n == 1 && ef[0].type == EF_PAINT);
+
+	//
+	// Drag: the window follows the cursor by the offset of the press,
+	// the same position is not moved twice, and the release ends it.
+	//
+	n = Post(&st, EV_MOUSEMOVE, 10, 10, ef);
+	CHECK(n == 2 && ef[0].type == EF_SET_CURSOR && ef[1].type == EF_DEFAULT);
+	n = Post(&st, EV_LBUTTONDOWN, 30, 40, ef);
+	CHECK(n == 1 && ef[0].type == EF_CAPTURE && st.mouseState == EMS_IN_MOVE);
+	n = Post(&st, EV_MOUSEMOVE, 35, 42, ef);
+	CHECK(n == 2 && ef[1].type == EF_MOVE_WINDOW);
+	CHECK(ef[1].rect.left == 105 && ef[1].rect.top == 202);
+	CHECK(ef[1].rect.right == 105 + DEFAULT_W && ef[1].rect.bottom == 202 + DEFAULT_H);
+	n = Post(&st, EV_MOUSEMOVE, 35, 42, ef);
+	CHECK(n == 1 && ef[0].type == EF_SET_CURSOR);
+	n = Post(&st, EV_LBUTTONUP, 35, 42, ef);
+	CHECK(n == 1 && ef[0].type == EF_RELEASE_CAPTURE && st.mouseState == EMS_NONE);
+	n = Post(&st, EV_LBUTTONUP, 35, 42, ef);
+	CHECK(n == 0);
+
+	//
+	// A double-click or right-click hides the frame, and another shows
+	// it again. Both rebuild the region.
+	//
+	n = Post(&st, EV_TOGGLE_MENU, 0, 0, ef);
+	CHECK(n == 1 && ef[0].type == EF_REDRAW && st.showMenu == 0 && st.resetClippingRegion);
+	n = Post(&st, EV_PAINT, 0, 0, ef);
+	CHECK(n == 2 && ef[0].type == EF_SET_REGION);
+	n = Post(&st, EV_TOGGLE_MENU, 0, 0, ef);
+	CHECK(n == 1 && st.showMenu == 1 && st.resetClippingRegion);
+
+	n = Post(&st, EV_TOGGLE_TOPMOST, 0, 0, ef);
+	CHECK(n == 1 && ef[0].type == EF_SET_TOPMOST && !st.showTopMost);
+	n = Post(&st, EV_TOGGLE_TOPMOST, 0, 0, ef);
+	CHECK(n == 1 && st.showTopMost);
+
+	//
+	// Default Size resizes the client, and WM_SIZE rebuilds the region.
+	// At the default size it only rebuilds the region and redraws.
+	//
+	Post(&st, EV_PAINT, 0, 0, ef);
+	n = Post(&st, EV_DEFAULT_SIZE, 300, 200, ef);
+	CHECK(n == 1 && ef[0].type == EF_RESIZE_CLIENT && !st.resetClippingRegion);
+	CHECK(ef[0].rect.left == 0 && ef[0].rect.top == 0);
+	CHECK(ef[0].rect.right == DEFAULT_W && ef[0].rect.bottom == DEFAULT_H);
+	n = Post(&st, EV_SIZE, DEFAULT_W, DEFAULT_H, ef);
+	CHECK(n == 1 && ef[0].type == EF_REDRAW && st.resetClippingRegion);
+	Post(&st, EV_PAINT, 0, 0, ef);
+	n = Post(&st, EV_DEFAULT_SIZE, DEFAULT_W, DEFAULT_H, ef);
+	CHECK(n == 1 && ef[0].type == EF_REDRAW && st.resetClippingRegion);
+}
+
+//
+// Flight recorder.
+//
+static void CollectEvent(void *ctx, const struct FlightEvent *ev)
+{
+	((std::vector<struct FlightEvent> *)ctx)->push_back(*ev);
+}
+
+static bool SameEvent(const struct FlightEvent *a, const struct FlightEvent *b)
+{
+	if (a->type != b->type || a->time != b->time)
+		return false;
+	return a->type != FR_CURSOR || (a->x == b->x && a->y == b->y && a->hookTime == b->hookTime);
+}
+
+static struct FlightEvent Event(uint32_t type, uint64_t time, int x, int y, uint32_t hookTime)
+{
+	struct FlightEvent ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	ev.time = time;
+	ev.x = x;
+	ev.y = y;
+	ev.hookTime = hookTime;
+	return ev;
+}
+
+static void TestFlightRoundTrip(void)
+{
+	//
+	// Negative deltas, the cursor left of and above the primary monitor,
+	// a gap of days, and the wrap of the 32bit hook time.
+	//
+	const struct FlightEvent events[] = {
+		Event(FR_CURSOR, 1000, 500, 400, 0xfffffff0u),
+		Event(FR_UPDATE, 1000, 0, 0, 0),
+		Event(FR_CURSOR, 1010, -1920, -5, 0x00000010u),
+		Event(FR_UPDATE_SKIP, 1010, 0, 0, 0),
+		Event(FR_CURSOR, 1010 + 300000000000ULL, 7679, 4319, 0x12345678u),
+		Event(FR_PAINT, 1010 + 300000000001ULL, 0, 0, 0),
+		Event(FR_CURSOR, 1ULL << 62, -32768, 32767, 0),
+	};
+	const int n = sizeof(events) / sizeof(events[0]);
+	std::vector<uint8_t> file(FlightFileSize(0));
+	std::vector<struct FlightEvent> out;
+	struct FlightWriter w;
+	struct FlightInfo info;
+
+	CHECK(FlightWriterInit(&w, file.data(), file.size(), 10000000));
+	FlightWriterAppend(&w, events, n);
+	FlightWriterSetDropped(&w, 3);
+	CHECK(FlightDecode(file.data(), file.size(), &info, CollectEvent, &out) == n);
+	CHECK(info.tickFrequency == 10000000 && info.dropped == 3 && info.segmentCount == FLIGHT_MIN_SEGMENTS);
+	CHECK(out.size() == (size_t)n);
+	for (size_t i = 0; i < out.size() && i < (size_t)n; i++)
+		CHECK(SameEvent(&out[i], &events[i]));
+
+	file[0] ^= 1;
+	CHECK(FlightDecode(file.data(), file.size(), NULL, NULL, NULL) == -1);
+}
+
+static void TestFlightRotation(void)
+{
+	std::vector<uint8_t> file(FlightFileSize(0));
+	std::vector<struct FlightEvent> in, out;
+	struct FlightWriter w;
+	long long n;
+
+	//
+	// Far more than the segments hold, written in batches as the
+	// recorder thread does.
+	//
+	for (int i = 0; i < 100000; i++)
+		in.push_back(Event(i % 3 ? FR_UPDATE : FR_CURSOR, 1000 + i * 7ULL, (i * 37) % 2000 - 1000, (i * 53) % 1000 - 500, i));
+	CHECK(FlightWriterInit(&w, file.data(), file.size(), 1000));
+	for (size_t i = 0; i < in.size(); i += 100)
+		FlightWriterAppend(&w, &in[i], 100);
+
+	//
+	// Only the tail survives, in order and without a gap.
+	//
+	n = FlightDecode(file.data(), file.size(), NULL, CollectEvent, &out);
+	CHECK(n > 0 && n < (long long)in.size() && out.size() == (size_t)n);
+	for (size_t i = 0; i < out.size(); i++) {
+		if (!SameEvent(&out[i], &in[in.size() - out.size() + i])) {
+			CHECK(!"rotated event");
+			break;
+		}
+	}
+}
+
+static void TestFlightRing(void)
+{
+	void *mem = EyesAlignedAlloc(sizeof(struct FlightRing), alignof(struct FlightRing));
+	std::vector<struct FlightEvent> out(FLIGHT_RING_SIZE + 10);
+	struct FlightRing *ring;
+	int pushed = 0;
+
+	CHECK(mem != NULL);
+	if (mem == NULL)
+		return;
+	ring = new (mem) struct FlightRing;
+	FlightRingInit(ring);
+	for (int i = 0; i < FLIGHT_RING_SIZE + 10; i++) {
+		struct FlightEvent ev = Event(FR_CURSOR, i, i, -i, i);
+
+		pushed += FlightRingPush(ring, &ev);
+	}
+	CHECK(pushed == FLIGHT_RING_SIZE);
+	CHECK(ring->dropped.load() == 10);
+
+	CHECK(FlightRingPop(ring, out.data(), 100) == 100);
+	CHECK(out[0].time == 0 && out[99].time == 99);
+	CHECK(FlightRingPop(ring, out.data(), (int)out.size()) == FLIGHT_RING_SIZE - 100);
+	CHECK(out[0].time == 100 && out[FLIGHT_RING_SIZE - 101].time == FLIGHT_RING_SIZE - 1);
+	CHECK(FlightRingPop(ring, out.data(), (int)out.size()) == 0);
+
+	//
+	// There is room again after the pop.
+	//
+	{
+		struct FlightEvent ev = Event(FR_PAINT, 12345, 0, 0, 0);
+
+		CHECK(FlightRingPush(ring, &ev));
+		CHECK(FlightRingPop(ring, out.data(), 1) == 1 && out[0].time == 12345);
+	}
+	CHECK(ring->dropped.load() == 10);
+
+	ring->~FlightRing();
+	EyesAlignedFree(ring);
+}
+
+//
+// The window region is exactly the painted outline of the eyes: no
+// outline pixel is clipped, and every span starts and ends on it, so
+// that no background is shown around the eyes.
+//
+static void TestRegion(void)
+{
+	//
+	// Sizes of the static tests of the layout in wineyes_core.cpp.
+	//
+	static const int sizes[][2] = {
+		{ DEFAULT_W, DEFAULT_H }, { 60, 40 }, { 1920, 1080 }, { 3840, 2160 },
+	};
+	struct EyesTilePool *pool = EyesTilePoolCreate(1);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int w = sizes[i][0], h = sizes[i][1];
+		std::vector<uint32_t> bits((size_t)w * h);
+		std::vector<struct EyesSpan> spans((size_t)h * NUM_EYES);
+		std::vector<bool> inside((size_t)w * h);
+		struct EyesLayout layout;
+		struct EyesFrame frame = { bits.data(), w, w, h };
+		int n, outside = 0;
+
+		EyesComputeLayout(w, h, &layout);
+		EyesPaintFace(pool, &frame, &layout, NULL);
+		n = EyesRegionSpans(&layout, h, spans.data());
+		CHECK(n > 0 && n <= h * NUM_EYES);
+
+		for (int k = 0; k < n; k++) {
+			const struct EyesSpan *s = &spans[k];
+
+			CHECK(s->y >= 0 && s->y < h && s->x0 >= 0 && s->x0 < s->x1 && s->x1 <= w);
+			if (s->y < 0 || s->y >= h || s->x0 < 0 || s->x0 >= s->x1 || s->x1 > w)
+				continue;
+			CHECK(bits[(size_t)s->y * w + s->x0] == 0);
+			CHECK(bits[(size_t)s->y * w + s->x1 - 1] == 0);
+			for (int x = s->x0; x < s->x1; x++)
+				inside[(size_t)s->y * w + x] = true;
+		}
+		for (size_t p = 0; p < bits.size(); p++) {
+			if (bits[p] == 0 && !inside[p])
+				outside++;
+		}
+		CHECK(outside == 0);
+	}
+	EyesTilePoolFree(pool);
+}
+
+//
+// The pupils are erased and drawn only inside of the sclera spans, so
+// that they are white in the face and inside of the window region, on
+// narrow and tall windows too.
+//
+static void TestSclera(void)
+{
+	static const int sizes[][2] = {
+		{ DEFAULT_W, DEFAULT_H }, { 80, 200 }, { 100, 100 }, { 300, 40 }, { 1920, 1080 },
+	};
+	struct EyesTilePool *pool = EyesTilePoolCreate(1);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int w = sizes[i][0], h = sizes[i][1];
+		std::vector<uint32_t> bits((size_t)w * h);
+		std::vector<struct EyesSpan> region((size_t)h * NUM_EYES), sclera((size_t)h * NUM_EYES);
+		std::vector<bool> inside((size_t)w * h);
+		struct EyesLayout layout;
+		struct EyesFrame frame = { bits.data(), w, w, h };
+		int nregion, nsclera, bad = 0;
+
+		EyesComputeLayout(w, h, &layout);
+		EyesPaintFace(pool, &frame, &layout, NULL);
+		nregion = EyesRegionSpans(&layout, h, region.data());
+		nsclera = EyesScleraSpans(&layout, h, sclera.data());
+		CHECK(nsclera > 0 && nsclera <= h * NUM_EYES);
+
+		for (int k = 0; k < nregion; k++) {
+			for (int x = region[k].x0; x < region[k].x1; x++)
+				inside[(size_t)region[k].y * w + x] = true;
+		}
+		for (int k = 0; k < nsclera; k++) {
+			for (int x = sclera[k].x0; x < sclera[k].x1; x++) {
+				size_t p = (size_t)sclera[k].y * w + x;
+
+				if (bits[p] != 0x00ffffff || !inside[p])
+					bad++;
+			}
+		}
+		CHECK(bad == 0);
+	}
+	EyesTilePoolFree(pool);
+}
+
+//
+// The cached face and region are the ones painted without the cache,
+// and a broken or foreign cache is refused. A torn page of the bitmap
+// is found in its band when the band is checked.
+//
+static void TestCache(void)
+{
+	struct EyesCacheKey small = { DEFAULT_W, DEFAULT_H };
+	struct EyesCacheKey key = { 1920, 1080 }, other = { 1080, 1920 };
+	struct EyesTilePool *pool = EyesTilePoolCreate(1);
+	size_t size = EyesCacheFileSize(&key);
+	std::vector<uint8_t> file(size);
+	std::vector<uint32_t> bits((size_t)key.width * key.height);
+	std::vector<struct EyesSpan> spans((size_t)key.height * NUM_EYES);
+	struct EyesFrame frame = { bits.data(), key.width, key.width, key.height };
+	struct EyesLayout layout;
+	struct EyesCache cache;
+	int n;
+
+	CHECK(EyesCacheFileSize(&small) == 0);
+	CHECK(size > 0);
+	CHECK(EyesCacheBuild(file.data(), size, &key, pool));
+	CHECK(EyesCacheOpen(file.data(), size, &key, &cache));
+	CHECK(!EyesCacheOpen(file.data(), size, &other, &cache));
+	CHECK(!EyesCacheOpen(file.data(), size - 1, &key, &cache));
+
+	EyesComputeLayout(key.width, key.height, &layout);
+	EyesPaintFace(pool, &frame, &layout, NULL);
+	n = EyesRegionSpans(&layout, key.height, spans.data());
+	CHECK(EyesCacheOpen(file.data(), size, NULL, &cache));
+	CHECK(cache.nspans == n && memcmp(cache.spans, spans.data(), n * sizeof(struct EyesSpan)) == 0);
+	CHECK(memcmp(cache.bits, bits.data(), bits.size() * sizeof(uint32_t)) == 0);
+	CHECK(EyesCacheCheckRows(&cache, 0, key.height));
+
+	size_t bitmap = (const uint8_t *)cache.bits - file.data();
+	size_t band = (size_t)key.width * CACHE_BAND_ROWS * sizeof(uint32_t);
+	std::vector<uint8_t> page(file.begin() + bitmap + 5 * band + 3 * CACHE_SAMPLE_BYTES,
+		file.begin() + bitmap + 5 * band + 4 * CACHE_SAMPLE_BYTES);
+	memset(&file[bitmap + 5 * band + 3 * CACHE_SAMPLE_BYTES], 0xa5, CACHE_SAMPLE_BYTES);
+	CHECK(EyesCacheCheckRows(&cache, 0, key.height));       // Already checked
+	CHECK(EyesCacheOpen(file.data(), size, &key, &cache));
+	CHECK(EyesCacheCheckRows(&cache, 0, 5 * CACHE_BAND_ROWS));
+	CHECK(EyesCacheCheckRows(&cache, 6 * CACHE_BAND_ROWS, key.height));
+	CHECK(!EyesCacheCheckRows(&cache, 5 * CACHE_BAND_ROWS + 1, 5 * CACHE_BAND_ROWS + 2));
+	CHECK(!EyesCacheCheckRows(&cache, 0, key.height));
+	memcpy(&file[bitmap + 5 * band + 3 * CACHE_SAMPLE_BYTES], page.data(), page.size());
+	CHECK(EyesCacheCheckRows(&cache, 0, key.height));
+	file[size - 1] ^= 1;
+	CHECK(EyesCacheOpen(file.data(), size, &key, &cache));
+	CHECK(!EyesCacheCheckRows(&cache, key.height - 1, key.height));
+	file[size - 1] ^= 1;
+
+	file[CACHE_HEADER_BYTES + 4] ^= 1;
+	CHECK(!EyesCacheOpen(file.data(), size, &key, &cache));
+	file[CACHE_HEADER_BYTES + 4] ^= 1;
+	file[cache.bandHash - file.data()] ^= 1;
+	CHECK(!EyesCacheOpen(file.data(), size, &key, &cache));
+	EyesTilePoolFree(pool);
+}
+
+//
+// The updates are limited to the rate and to the bytes/second of the
+// budget, whose credit is refilled over time up to the burst.
+//
+static void TestBudget(void)
+{
+	struct EyesBudget b;
+
+	EyesBudgetInit(&b, 10, 1000, 1, 0);
+	CHECK(EyesBudgetRequest(&b, 0, 100) == 0);
+	CHECK(EyesBudgetRequest(&b, 40, 100) == 60);
+	CHECK(b.pending && b.deferred == 1);
+	CHECK(EyesBudgetRequest(&b, 70, 100) == 30);
+	CHECK(b.deferred == 1);
+	CHECK(EyesBudgetRequest(&b, 100, 100) == 0);
+	CHECK(!b.pending && b.sent == 2 && b.bytes == 200);
+
+	//
+	// The burst is spent at once, and then refilled at the rate.
+	//
+	EyesBudgetInit(&b, 0, 1000, 1, 0);
+	CHECK(EyesBudgetRequest(&b, 0, 1000) == 0);
+	CHECK(EyesBudgetRequest(&b, 0, 500) == 500);
+	CHECK(EyesBudgetRequest(&b, 250, 500) == 250);
+	CHECK(EyesBudgetRequest(&b, 500, 500) == 0);
+
+	//
+	// A long idle time does not save up more than the burst.
+	//
+	CHECK(EyesBudgetRequest(&b, 1000000, 1000) == 0);
+	CHECK(EyesBudgetRequest(&b, 1000000, 1) == 1);
+
+	//
+	// An update larger than the burst waits until it is paid for, and
+	// one charged regardless of the budget delays the next.
+	//
+	EyesBudgetInit(&b, 0, 1000, 1, 0);
+	CHECK(EyesBudgetRequest(&b, 0, 3000) == 2000);
+	CHECK(EyesBudgetRequest(&b, 1999, 3000) == 1);
+	CHECK(EyesBudgetRequest(&b, 2000, 3000) == 0);
+	EyesBudgetCharge(&b, 5000, 1500);
+	CHECK(EyesBudgetRequest(&b, 5000, 1) == 501);
+}
+
+//
+// A held back update is retried with the latest cursor position, as
+// RemoteAdmit() does, so that the pupils rest where the cursor stops.
+//
+static void TestBudgetRest(void)
+{
+	struct EyesLayout layout;
+	struct EyesBudget b;
+	struct EyesPoint drawn[NUM_EYES], rest[NUM_EYES], mouse;
+	long long now, timer = -1;
+	bool isDrawn = false;
+
+	EyesComputeLayout(DEFAULT_W, DEFAULT_H, &layout);
+	EyesBudgetInit(&b, DEFAULT_REMOTE_FPS, 2048, DEFAULT_REMOTE_GRID, 0);
+	memset(drawn, 0, sizeof(drawn));
+
+	for (now = 0; now < 3000 || timer >= 0; now++) {
+		struct EyesPoint pupil[NUM_EYES];
+		long long cost;
+
+		//
+		// The cursor circles the window every 400 ms for 2 s and stops.
+		//
+		if (now < 2000 && now % 7 == 0) {
+			mouse.x = DEFAULT_W / 2 + (int)(200 * cos(now * 2 * TEST_PI / 400));
+			mouse.y = DEFAULT_H / 2 + (int)(200 * sin(now * 2 * TEST_PI / 400));
+		}
+		else if (now != timer) {
+			continue;
+		}
+		timer = -1;
+
+		EyesLookAt(mouse, &layout, pupil);
+		EyesBudgetQuantize(&b, &layout, pupil);
+		if (isDrawn && memcmp(pupil, drawn, sizeof(drawn)) == 0) {
+			b.pending = false;
+			continue;
+		}
+		cost = EyesPupilChange(isDrawn ? drawn : NULL, pupil, layout.eyeballsize);
+		int wait = EyesBudgetRequest(&b, now, cost);
+		if (wait > 0) {
+			timer = now + wait;
+			continue;
+		}
+		memcpy(drawn, pupil, sizeof(drawn));
+		isDrawn = true;
+	}
+
+	EyesLookAt(mouse, &layout, rest);
+	EyesBudgetQuantize(&b, &layout, rest);
+	CHECK(b.deferred > 0);
+	CHECK(b.bytes <= 2048 + 2048 * b.lastSent / 1000);
+	CHECK(isDrawn && memcmp(drawn, rest, sizeof(rest)) == 0);
+}
+
+//
+// The snapped pupils stay within the travel of the eyes, for any grid.
+//
+static void TestBudgetQuantize(void)
+{
+	static const int sizes[][2] = {
+		{ DEFAULT_W, DEFAULT_H }, { 60, 40 }, { 80, 200 }, { 300, 40 }, { 1920, 1080 },
+	};
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		struct EyesLayout layout;
+		int bad = 0;
+
+		EyesComputeLayout(sizes[i][0], sizes[i][1], &layout);
+		double ex = (double)layout.eyesize.x * SUBPIXEL_ONE;
+		double ey = (double)layout.eyesize.y * SUBPIXEL_ONE;
+
+		for (int grid = 1; grid <= 30; grid++) {
+			struct EyesBudget b;
+
+			EyesBudgetInit(&b, 0, 1, grid, 0);
+			for (int a = 0; a < 360; a++) {
+				struct EyesPoint mouse, pupil[NUM_EYES];
+
+				mouse.x = (int)(10000 * cos(a * TEST_PI / 180));
+				mouse.y = (int)(10000 * sin(a * TEST_PI / 180));
+				EyesLookAt(mouse, &layout, pupil);
+				EyesBudgetQuantize(&b, &layout, pupil);
+				for (int e = 0; e < NUM_EYES; e++) {
+					int x = pupil[e].x - layout.center[e].x * SUBPIXEL_ONE;
+					int y = pupil[e].y - layout.center[e].y * SUBPIXEL_ONE;
+
+					if (x % (grid * SUBPIXEL_ONE) != 0 || y % (grid * SUBPIXEL_ONE) != 0 ||
+						(x / ex) * (x / ex) + (y / ey) * (y / ey) > 1.0 + 1e-9)
+						bad++;
+				}
+			}
+		}
+		CHECK(bad == 0);
+	}
+}
+
+//
+// The charge of a move covers every pixel which the pupils change.
+//
+static void TestPupilChange(void)
+{
+	static const int sizes[][2] = { { DEFAULT_W, DEFAULT_H }, { 1920, 1080 } };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int w = sizes[i][0], h = sizes[i][1];
+		std::vector<uint32_t> bits((size_t)w * h, 0x00ffffff), before;
+		struct EyesLayout layout;
+		struct EyesPoint prev[NUM_EYES], next[NUM_EYES], ebsize;
+		struct EyesBudget b;
+		int bad = 0;
+
+		EyesComputeLayout(w, h, &layout);
+		EyesBudgetInit(&b, 0, 1, 1, 0);
+		ebsize = layout.eyeballsize;
+		for (int k = 0; k <= 64; k++) {
+			struct EyesPoint mouse;
+			long long changed = 0, charge;
+
+			mouse.x = (k * 7919) % (3 * w) - w;
+			mouse.y = (k * 104729) % (3 * h) - h;
+			EyesLookAt(mouse, &layout, next);
+			EyesBudgetQuantize(&b, &layout, next);
+			charge = EyesPupilChange(k ? prev : NULL, next, ebsize);
+			if (k && memcmp(prev, next, sizeof(next)) == 0)
+				CHECK(charge == 0);
+
+			before = bits;
+			for (int e = 0; e < NUM_EYES && k; e++) {
+				struct EyesRect r = EyesPupilRect(prev[e], ebsize);
+
+				for (int y = r.top; y < r.bottom; y++) {
+					for (int x = r.left; x < r.right; x++)
+						bits[(size_t)y * w + x] = 0x00ffffff;
+				}
+			}
+			for (int e = 0; e < NUM_EYES; e++) {
+				struct EyesRect r = EyesPupilRect(next[e], ebsize);
+
+				EyesRasterizePupil(bits.data() + (size_t)r.top * w + r.left, w,
+					r.right - r.left, r.bottom - r.top,
+					(double)next[e].x / SUBPIXEL_ONE - r.left, (double)next[e].y / SUBPIXEL_ONE - r.top,
+					ebsize.x, ebsize.y);
+			}
+			for (size_t p = 0; p < bits.size(); p++)
+				changed += k && bits[p] != before[p] ? REMOTE_BYTES_PER_PIXEL : 0;
+			if (changed > charge)
+				bad++;
+			memcpy(prev, next, sizeof(prev));
+		}
+		CHECK(bad == 0);
+
+		//
+		// The first paint is charged for the pupils, less than the cells.
+		//
+		struct EyesRect cell = EyesPupilRect(next[LEYE], ebsize);
+		long long first = EyesPupilChange(NULL, next, ebsize);
+		CHECK(first > 0);
+		CHECK(first < NUM_EYES * REMOTE_BYTES_PER_PIXEL *
+			(long long)(cell.right - cell.left) * (cell.bottom - cell.top));
+	}
+}
+
+//
+// A forwarded launch is decoded to the options of the command line,
+// and a broken or foreign message is refused.
+//
+static void TestLaunch(void)
+{
+	const wchar_t *argv[] = {
+		L"-geometry", L"300x200+10+20", L"-record", L"eyes\U0001F440\u00e9.xefr",
+	};
+	static wchar_t many[LAUNCH_MAX_ARGS + 1][2] = { { 0 } };
+	wchar_t *manyArgv[LAUNCH_MAX_ARGS + 1];
+	std::vector<wchar_t> longArg(LAUNCH_MAX_BYTES / 2, L'x');
+	wchar_t *longArgv[] = { longArg.data() };
+	uint8_t msg[LAUNCH_MAX_BYTES];
+	struct EyesOptions opt, ref;
+	size_t n;
+
+	n = EyesLaunchEncode(4, (wchar_t **)argv, msg, sizeof(msg));
+	CHECK(n > LAUNCH_HEADER_BYTES);
+	CHECK(EyesLaunchEncode(4, (wchar_t **)argv, NULL, 0) == n);
+	CHECK(EyesLaunchEncode(4, (wchar_t **)argv, msg, n - 1) == 0);
+	EyesParseOptions(4, (wchar_t **)argv, &ref);
+	CHECK(EyesLaunchDecode(msg, n, &opt));
+	CHECK(opt.geometryWidth == 300 && opt.geometryHeight == 200);
+	CHECK(wcscmp(opt.recordPath, ref.recordPath) == 0);
+	CHECK(wcscmp(opt.recordPath, argv[3]) == 0);
+	CHECK(!EyesLaunchForwardable(&opt));
+	CHECK(EyesLaunchEncode(0, NULL, msg, sizeof(msg)) == LAUNCH_HEADER_BYTES);
+	CHECK(EyesLaunchDecode(msg, LAUNCH_HEADER_BYTES, &opt) && EyesLaunchForwardable(&opt));
+
+	//
+	// Foreign, broken and truncated messages.
+	//
+	n = EyesLaunchEncode(4, (wchar_t **)argv, msg, sizeof(msg));
+	CHECK(!EyesLaunchDecode(NULL, n, &opt));
+	for (size_t i = 0; i < n; i++)
+		CHECK(!EyesLaunchDecode(msg, i, &opt));
+	msg[0] ^= 1;
+	CHECK(!EyesLaunchDecode(msg, n, &opt));
+	msg[0] ^= 1;
+	msg[4]++;
+	CHECK(!EyesLaunchDecode(msg, n, &opt));
+	msg[4]--;
+	msg[n - 1] ^= 1;
+	CHECK(!EyesLaunchDecode(msg, n, &opt));
+	msg[n - 1] ^= 1;
+	CHECK(EyesLaunchDecode(msg, n, &opt));
+
+	//
+	// Too many arguments or bytes.
+	//
+	for (int i = 0; i <= LAUNCH_MAX_ARGS; i++) {
+		many[i][0] = L'a';
+		manyArgv[i] = many[i];
+	}
+	CHECK(EyesLaunchEncode(LAUNCH_MAX_ARGS, manyArgv, msg, sizeof(msg)) > 0);
+	CHECK(EyesLaunchEncode(LAUNCH_MAX_ARGS + 1, manyArgv, msg, sizeof(msg)) == 0);
+	longArg.back() = L'\0';
+	CHECK(EyesLaunchEncode(1, longArgv, msg, sizeof(msg)) == 0);
+	CHECK(EyesLaunchEncode(1, longArgv, NULL, 0) == 0);
+	longArg[(LAUNCH_MAX_BYTES - LAUNCH_HEADER_BYTES) / 2 - 1] = L'\0';
+	CHECK(EyesLaunchEncode(1, longArgv, msg, sizeof(msg)) == LAUNCH_MAX_BYTES);
+	CHECK(EyesLaunchDecode(msg, LAUNCH_MAX_BYTES, &opt));
+
+#ifndef _WIN32
+	//
+	// Through a local socket, as the benchmark forwards a launch.
+	//
+	int sv[2];
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	n = EyesLaunchEncode(4, (wchar_t **)argv, msg, sizeof(msg));
+	CHECK(write(sv[0], msg, n) == (ssize_t)n);
+	close(sv[0]);
+	memset(msg, 0, sizeof(msg));
+	size_t got = 0;
+	for (ssize_t r; (r = read(sv[1], msg + got, sizeof(msg) - got)) > 0; )
+		got += r;
+	close(sv[1]);
+	CHECK(got == n);
+	CHECK(EyesLaunchDecode(msg, got, &opt) && wcscmp(opt.recordPath, argv[3]) == 0);
+#endif
+}
+
+int main(void)
+{
+	TestGeometry();
+	TestOptions();
+	TestAlignedAlloc();
+	TestState();
+	TestFlightRoundTrip();
+	TestFlightRotation();
+	TestFlightRing();
+	TestRegion();
+	TestSclera();
+	TestCache();
+	TestBudget();
+	TestBudgetRest();
+	TestBudgetQuantize();
+	TestPupilChange();
+	TestLaunch();
+
+	if (g_failed)
+		fprintf(stderr, "%d checks failed\n", g_failed);
+	return g_failed ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Tile-parallel CPU renderer of the face.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include "wineyes_tile.h"
+
+#define FACE_WHITE 0x00ffffff
+#define FACE_BLACK 0x00000000
+
+//
+// Tiles of a worker. The owner and the thieves take the tiles from
+// the front one by one.
+//
+struct TileQueue {
+	alignas(64) std::atomic<int> next;
+	int end;
+};
+
+struct EyesTilePool {
+	int threads;
+	std::vector<std::thread> workers;
+	struct TileQueue *queues;
+
+	std::mutex lock;
+	std::condition_variable start;
+	std::condition_variable done;
+	unsigned long long generation;  // Incremented by each job
+	int active;                     // Workers running the job
+	bool quit;
+
+	int shares;                     // Number of queues of the job
+	EyesTileFunc fn;
+	void *ctx;
+};
+
+//
+// Run the own queue, and then steal from the others.
+//
+static void RunShare(struct EyesTilePool *pool, int id)
+{
+	int shares = pool->shares;
+
+	for (int k = 0; k < shares; k++) {
+		struct TileQueue *q = &pool->queues[(id + k) % shares];
+
+		for (;;) {
+			int i = q->next.fetch_add(1, std::memory_order_relaxed);
+			if (i >= q->end)
+				break;
+			pool->fn(pool->ctx, i);
+		}
+	}
+}
+
+static void PoolWorker(struct EyesTilePool *pool, int id)
+{
+	unsigned long long seen = 0;
+
+	for (;;) {
+		std::unique_lock<std::mutex> lk(pool->lock);
+
+		pool->start.wait(lk, [&] { return pool->quit || pool->generation != seen; });
+		if (pool->quit)
+			return;
+		seen = pool->generation;
+		lk.unlock();
+
+		if (id < pool->shares)
+			RunShare(pool, id);
+
+		lk.lock();
+		if (--pool->active == 0)
+			pool->done.notify_one();
+	}
+}
+
+struct EyesTilePool *EyesTilePoolCreate(int threads)
+{
+	struct EyesTilePool *pool = new struct EyesTilePool;
+
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	//
+	// The queues are on their own cache lines, which new does not
+	// guarantee before C++17.
+	//
+	pool->queues = (struct TileQueue *)EyesAlignedAlloc(threads * sizeof(struct TileQueue),
+		alignof(struct TileQueue));
+	if (pool->queues == NULL) {
+		delete pool;
+		throw std::bad_alloc();
+	}
+	for (int i = 0; i < threads; i++)
+		new (&pool->queues[i]) struct TileQueue;
+
+	pool->threads = threads;
+	pool->generation = 0;
+	pool->active = 0;
+	pool->quit = false;
+	pool->shares = 0;
+	pool->fn = NULL;
+	pool->ctx = NULL;
+
+	//
+	// The calling thread is the worker 0.
+	//
+	for (int i = 1; i < threads; i++)
+		pool->workers.push_back(std::thread(PoolWorker, pool, i));
+	return pool;
+}
+
+void EyesTilePoolFree(struct EyesTilePool *pool)
+{
+	if (pool == NULL)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lk(pool->lock);
+		pool->quit = true;
+	}
+	pool->start.notify_all();
+	for (std::thread &t : pool->workers)
+		t.join();
+
+	for (int i = 0; i < pool->threads; i++)
+		pool->queues[i].~TileQueue();
+	EyesAlignedFree(pool->queues);
+	delete pool;
+}
+
+int EyesTilePoolThreads(const struct EyesTilePool *pool)
+{
+	return pool->threads;
+}
+
+void EyesTilePoolRun(struct EyesTilePool *pool, int count, EyesTileFunc fn, void *ctx)
+{
+	int shares = std::min(pool->threads, count);
+
+	if (count <= 0)
+		return;
+
+	if (shares == 1) {
+		for (int i = 0; i < count; i++)
+			fn(ctx, i);
+		return;
+	}
+
+	for (int i = 0; i < shares; i++) {
+		pool->queues[i].next.store((int)((long long)count * i / shares), std::memory_order_relaxed);
+		pool->queues[i].end = (int)((long long)count * (i + 1) / shares);
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(pool->lock);
+		pool->shares = shares;
+		pool->fn = fn;
+		pool->ctx = ctx;
+		pool->active = pool->threads - 1;
+		pool->generation++;
+	}
+	pool->start.notify_all();
+
+	RunShare(pool, 0);
+
+	std::unique_lock<std::mutex> lk(pool->lock);
+	pool->done.wait(lk, [&] { return pool->active == 0; });
+}
+
+//
+// Spans of the outline and the white of the eyes on a row.
+// An empty span has x0 == x1.
+//
+struct FaceRow {
+	int outline[NUM_EYES][2];
+	int sclera[NUM_EYES][2];
+};
+
+struct PaintCtx {
+	const struct EyesFrame *frame;
+	const struct FaceRow *rows;   // Rows from the first tile row
+	int tileX;      // First tile of the damaged area
+	int tileY;
+	int tilesX;     // Tiles per row of the damaged area
+};
+
+static void FillSpan(uint32_t *row, int x0, int x1, int clip0, int clip1, uint32_t color)
+{
+	if (x0 < clip0)
+		x0 = clip0;
+	if (x1 > clip1)
+		x1 = clip1;
+	for (int x = x0; x < x1; x++)
+		row[x] = color;
+}
+
+static void PaintTile(void *param, int index)
+{
+	const struct PaintCtx *ctx = (const struct PaintCtx *)param;
+	const struct EyesFrame *frame = ctx->frame;
+	int x0 = (ctx->tileX + index % ctx->tilesX) * EYES_TILE_W;
+	int y0 = (ctx->tileY + index / ctx->tilesX) * EYES_TILE_H;
+	int x1 = std::min(x0 + EYES_TILE_W, frame->width);
+	int y1 = std::min(y0 + EYES_TILE_H, frame->height);
+
+	for (int y = y0; y < y1; y++) {
+		uint32_t *row = frame->bits + (size_t)y * frame->stride;
+		const struct FaceRow *fr = &ctx->rows[y - ctx->tileY * EYES_TILE_H];
+
+		FillSpan(row, x0, x1, x0, x1, FACE_WHITE);
+		for (int i = 0; i < NUM_EYES; i++) {
+			FillSpan(row, fr->outline[i][0], fr->outline[i][1], x0, x1, FACE_BLACK);
+			FillSpan(row, fr->sclera[i][0], fr->sclera[i][1], x0, x1, FACE_WHITE);
+		}
+	}
+}
+
+static void RowSpan(const struct EyesRect *r, int y, int span[2], int *hint)
+{
+	if (!EyesEllipseSpan(r, y, &span[0], &span[1], hint))
+		span[0] = span[1] = 0;
+}
+
+int EyesPaintFace(struct EyesTilePool *pool, const struct EyesFrame *frame,
+	const struct EyesLayout *layout, const struct EyesRect *damage)
+{
+	struct EyesRect d = { 0, 0, frame->width, frame->height };
+	std::vector<struct FaceRow> rows;
+	struct PaintCtx ctx;
+	int tilesY, y0, y1;
+	int hint[2][NUM_EYES] = { { 0 } };
+
+	if (damage) {
+		d.left = std::max(d.left, damage->left);
+		d.top = std::max(d.top, damage->top);
+		d.right = std::min(d.right, damage->right);
+		d.bottom = std::min(d.bottom, damage->bottom);
+	}
+	if (d.left >= d.right || d.top >= d.bottom)
+		return 0;
+
+	ctx.frame = frame;
+	ctx.tileX = d.left / EYES_TILE_W;
+	ctx.tileY = d.top / EYES_TILE_H;
+	ctx.tilesX = (d.right - 1) / EYES_TILE_W - ctx.tileX + 1;
+	tilesY = (d.bottom - 1) / EYES_TILE_H - ctx.tileY + 1;
+
+	//
+	// The spans are shared by the tiles of a row. They are walked from
+	// the top with integer square roots.
+	//
+	y0 = ctx.tileY * EYES_TILE_H;
+	y1 = std::min((ctx.tileY + tilesY) * EYES_TILE_H, frame->height);
+	rows.resize(y1 - y0);
+	for (int y = y0; y < y1; y++) {
+		for (int i = 0; i < NUM_EYES; i++) {
+			RowSpan(&layout->outline[i], y, rows[y - y0].outline[i], &hint[0][i]);
+			RowSpan(&layout->sclera[i], y, rows[y - y0].sclera[i], &hint[1][i]);
+		}
+	}
+	ctx.rows = rows.data();
+
+	EyesTilePoolRun(pool, ctx.tilesX * tilesY, PaintTile, &ctx);
+	return ctx.tilesX * tilesY;
+}
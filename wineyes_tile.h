@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xeyes for Windows
+ *
+ * (C) 2022 Yutaka Hirata(YOULAB)
+ *
+ * Tile-parallel CPU renderer of the face.
+ *
+ * The framebuffer is split into EYES_TILE_W x EYES_TILE_H tiles, which
+ * fit in the L1 data cache. The tiles which intersect the damaged area
+ * are rasterized on a work-stealing thread pool: each worker starts
+ * from its own share of the tiles and steals from the others when it
+ * runs out. This part does not depend on Win32.
+ */
+
+#ifndef _WINEYES_TILE_H_
+#define _WINEYES_TILE_H_
+
+#include "wineyes_core.h"
+
+//
+// 128 x 32 pixels of 32bit, 16KiB per tile.
+//
+#define EYES_TILE_W 128
+#define EYES_TILE_H 32
+
+//
+// Windows of this many pixels or more are painted by the tile renderer,
+// smaller ones by GDI.
+//
+#define TILE_PAINT_MIN_PIXELS (1024 * 1024)
+
+//
+// Top-down 32bit BGR framebuffer. The stride is given in pixels.
+//
+struct EyesFrame {
+	uint32_t *bits;
+	int stride;
+	int width;
+	int height;
+};
+
+struct EyesTilePool;
+
+//
+// Create a pool of 'threads' workers including the calling thread.
+// 0 means the number of processors.
+//
+struct EyesTilePool *EyesTilePoolCreate(int threads);
+void EyesTilePoolFree(struct EyesTilePool *pool);
+int EyesTilePoolThreads(const struct EyesTilePool *pool);
+
+//
+// Call fn(ctx, i) for i in [0, count) on the pool, and return after
+// all of them are done.
+//
+typedef void (*EyesTileFunc)(void *ctx, int index);
+void EyesTilePoolRun(struct EyesTilePool *pool, int count, EyesTileFunc fn, void *ctx);
+
+//
+// Paint the white background, the outlines and the whites of the eyes
+// into the tiles which intersect 'damage', or the whole frame if NULL.
+// Returns the number of tiles painted.
+//
+int EyesPaintFace(struct EyesTilePool *pool, const struct EyesFrame *frame,
+	const struct EyesLayout *layout, const struct EyesRect *damage);
+
+#endif   /* _WINEYES_TILE_H_ */